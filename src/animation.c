@@ -0,0 +1,217 @@
+/**
+ * @file animation.c
+ *
+ * @brief source file that contains the frame loop that drives software animations on the keyboard
+ */
+
+#include "animation.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static volatile sig_atomic_t stop_requested = 0;
+static struct sigaction old_int_action;
+static struct sigaction old_term_action;
+
+/**
+ * @brief signal handler that stops the frame loop after the current frame
+ */
+static void on_stop_signal(int signal)
+{
+    (void)signal;
+    stop_requested = 1;
+}
+
+/**
+ * @brief sends all regions that changed since the previous frame and commits them
+ * @returns the number of sent reports, -1 on error
+ */
+static int send_frame(hid_device* dev, const struct color* frame, struct color* sent, bool* sent_valid, int num_regions)
+{
+    int ret = 0;
+    for (int i=0; i<num_regions && ret >= 0; ++i)
+    {
+        if (!sent_valid[i] || frame[i].red != sent[i].red || frame[i].green != sent[i].green || frame[i].blue != sent[i].blue)
+        {
+            int length = set_color(dev, frame[i], i+1, rgb);
+            if (length >= 0) //nothing is sent for regions the keyboard does not have
+            {
+                sent[i] = frame[i];
+                sent_valid[i] = true;
+                if (length > 0)
+                    ++ret;
+            }
+            else
+            {
+                ret = -1;
+            }
+        }
+    }
+
+    //the colors only take effect with a commit, which is only required if anything changed at all
+    if (ret > 0)
+        ret = set_mode(dev, normal) > 0 ? ret + 1 : -1;
+    return ret;
+}
+
+void animation_catch_signals(bool enable)
+{
+    if (enable)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = on_stop_signal;
+        stop_requested = 0;
+        sigaction(SIGINT, &action, &old_int_action);
+        sigaction(SIGTERM, &action, &old_term_action);
+    }
+    else
+    {
+        sigaction(SIGINT, &old_int_action, NULL);
+        sigaction(SIGTERM, &old_term_action, NULL);
+    }
+}
+
+bool animation_stop_requested()
+{
+    return stop_requested != 0;
+}
+
+void timespec_advance(struct timespec* time, long nanoseconds)
+{
+    time->tv_nsec += nanoseconds;
+    while (time->tv_nsec >= 1000000000L)
+    {
+        time->tv_nsec -= 1000000000L;
+        ++time->tv_sec;
+    }
+}
+
+double timespec_seconds_between(const struct timespec* from, const struct timespec* to)
+{
+    return (double)(to->tv_sec - from->tv_sec) + (double)(to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+void animation_options_init(struct animation_options* options)
+{
+    power_policy_init(&options->policy);
+    options->num_regions = 3;
+    options->duration = 0;
+    realtime_options_init(&options->realtime);
+    options->jitter = false;
+}
+
+int animate(hid_device** dev, render_callback render, void* context, const struct animation_options* options)
+{
+    int ret = -1;
+    struct power_monitor monitor;
+    int num_regions = options->num_regions;
+    if (num_regions > 0 && num_regions <= ANIMATION_MAX_REGIONS && power_monitor_open(&monitor, &options->policy) == 0)
+    {
+        animation_catch_signals(true);
+        if (realtime_enter(&options->realtime) != 0)
+            printf("animation: the real-time profile could not be applied completely (requires root)\n");
+        struct jitter_histogram jitter;
+        jitter_reset(&jitter);
+
+        //the frame is allocated once and rendered in place, the sent state is used to skip unchanged regions
+        struct color frame[ANIMATION_MAX_REGIONS];
+        struct color sent[ANIMATION_MAX_REGIONS];
+        bool sent_valid[ANIMATION_MAX_REGIONS];
+        memset(frame, 0, sizeof(frame));
+        for (int i=0; i<num_regions; ++i)
+        {
+            frame[i].profile = custom;
+            sent_valid[i] = false;
+        }
+
+        struct timespec start, now, deadline, due;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        deadline = due = start;
+        double last_t = 0;
+        bool fallback_active = false;
+        ret = 0;
+
+        while (ret == 0 && !animation_stop_requested())
+        {
+            //the duration also ends an animation that is idle or in the firmware fallback, the waits below never sleep past it
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double t = timespec_seconds_between(&start, &now);
+            if (options->duration > 0 && t >= options->duration)
+                break;
+            int remaining_ms = options->duration > 0 ? (int)((options->duration - t) * 1000) + 1 : -1;
+
+            enum power_state state = power_update(&monitor);
+            long interval = power_frame_interval(&monitor, state);
+
+            //after an interrupted sleep, the device stays closed until the user is active again
+            if (*dev == NULL && state != power_idle && (*dev = open_keyboard()) == NULL)
+            {
+                ret = -1;
+            }
+            else if (state == power_idle)
+            {
+                //no traffic at all while idle; the firmware keeps showing the last committed frame
+                //an interrupted sleep leaves the device closed, the loop condition checks if the animation has to stop
+                if (power_sleep(&monitor, dev, remaining_ms) < 0)
+                    ret = -1;
+                for (int i=0; i<num_regions; ++i)
+                    sent_valid[i] = false;
+                fallback_active = false;
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                due = deadline;
+            }
+            else if (interval == 0)
+            {
+                //on battery without a software frame rate: let the firmware animate and only wake up to re-check the power state
+                if (!fallback_active)
+                {
+                    if (set_mode(*dev, options->policy.battery_mode) > 0)
+                        power_account_reports(&monitor, 1);
+                    else
+                        ret = -1;
+                    for (int i=0; i<num_regions; ++i)
+                        sent_valid[i] = false;
+                    fallback_active = true;
+                }
+                power_wait_activity(&monitor, remaining_ms >= 0 && remaining_ms < 5000 ? remaining_ms : 5000);
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                due = deadline;
+            }
+            else
+            {
+                fallback_active = false;
+                if (render(context, frame, num_regions, t, t - last_t) != 0)
+                    break;
+                last_t = t;
+
+                //the jitter is the delay between the frame's original deadline and the point in time its reports are sent
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                jitter_record(&jitter, &due, &now);
+                int sent_reports = send_frame(*dev, frame, sent, sent_valid, num_regions);
+                if (sent_reports >= 0)
+                    power_account_reports(&monitor, sent_reports);
+                else
+                    ret = -1;
+
+                //sleep until the next absolute deadline, frames that are already late are skipped instead of queued
+                //(the schedule moves, but the late frame's jitter is still measured against the deadline it missed)
+                timespec_advance(&deadline, interval);
+                due = deadline;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (timespec_seconds_between(&now, &deadline) < 0)
+                    deadline = now;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+                power_account_wakeup(&monitor);
+            }
+        }
+
+        realtime_leave(&options->realtime);
+        animation_catch_signals(false);
+        power_monitor_close(&monitor);
+        if (options->jitter)
+            jitter_print(&jitter);
+    }
+    return ret;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file animation.h
+ *
+ * @brief header file for the frame loop that drives software animations on the keyboard
+ */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <time.h>
+#include "msiklm.h"
+#include "power.h"
+#include "realtime.h"
+
+#define ANIMATION_MAX_REGIONS 7
+
+/**
+ * @brief render callback: renders the frame at time t into the preallocated frame array
+ * @param context the callback's context as passed to animate()
+ * @param frame the frame to render into; it still contains the previously rendered frame
+ * @param num_regions the number of regions in the frame
+ * @param t the time in seconds since the animation started
+ * @param dt the time in seconds since the previous frame
+ * @returns 0 to continue the animation, -1 to stop it
+ */
+typedef int (*render_callback)(void* context, struct color* frame, int num_regions, double t, double dt);
+
+/**
+ * @brief animation options struct: configures the frame loop
+ */
+struct animation_options
+{
+    struct power_policy policy;    //frame rates, battery fallback and idle handling
+    int num_regions;               //number of regions to animate, starting with the left one
+    double duration;               //duration in seconds, 0 runs until the process is interrupted
+    struct realtime_options realtime; //scheduling policy, CPU pinning and memory locking of the frame loop
+    bool jitter;                   //print the histogram of the delays between the frame deadlines and the send times
+};
+
+/**
+ * @brief initializes the animation options with their default values (three regions, infinite duration, default power policy, normal scheduling)
+ * @param options the options to initialize
+ */
+void animation_options_init(struct animation_options* options);
+
+/**
+ * @brief runs the frame loop: renders frames at the policy's frame rate and sends only the regions that changed since the previous frame
+ * @param dev the hid device; it might be closed and reopened while the user is idle
+ * @param render the render callback
+ * @param context the render callback's context
+ * @param options the animation options
+ * @returns 0 if the animation finished or was interrupted (SIGINT / SIGTERM), -1 on error
+ */
+int animate(hid_device** dev, render_callback render, void* context, const struct animation_options* options);
+
+/**
+ * @brief installs (or restores the previous) SIGINT and SIGTERM handlers that request long-running loops to stop
+ * @param enable true to install the handlers, false to restore the previous ones
+ */
+void animation_catch_signals(bool enable);
+
+/**
+ * @brief checks if SIGINT or SIGTERM was received since animation_catch_signals() was called
+ * @returns true if the loop should stop
+ */
+bool animation_stop_requested();
+
+/**
+ * @brief advances a point in time by the given number of nanoseconds
+ * @param time the point in time
+ * @param nanoseconds the nanoseconds to add (non-negative)
+ */
+void timespec_advance(struct timespec* time, long nanoseconds);
+
+/**
+ * @brief returns the difference between two points in time
+ * @param from the earlier point in time
+ * @param to the later point in time
+ * @returns the difference in seconds (negative if to is before from)
+ */
+double timespec_seconds_between(const struct timespec* from, const struct timespec* to);
+
+#endif //ANIMATION_H
@@ -0,0 +1,237 @@
+/**
+ * @file effect.c
+ *
+ * @brief source file that contains the parameterized software effects
+ */
+
+#include "effect.h"
+#include <math.h>
+#include <string.h>
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * @brief creates a custom color from the given (unclamped) channel values
+ */
+static struct color make_color(double red, double green, double blue)
+{
+    struct color ret;
+    ret.profile = custom;
+    ret.red = (byte)(red < 0 ? 0 : red > 255 ? 255 : red + 0.5);
+    ret.green = (byte)(green < 0 ? 0 : green > 255 ? 255 : green + 0.5);
+    ret.blue = (byte)(blue < 0 ? 0 : blue > 255 ? 255 : blue + 0.5);
+    return ret;
+}
+
+/**
+ * @brief scales a color by the given intensity (0 to 1)
+ */
+static struct color scale_color(struct color color, double intensity)
+{
+    return make_color(color.red * intensity, color.green * intensity, color.blue * intensity);
+}
+
+/**
+ * @brief evaluates the gradient at position x (0 to 1); a cyclic gradient interpolates from the last stop back to the first one
+ */
+static struct color gradient_at(const struct effect* effect, double x, bool cyclic)
+{
+    int segments = cyclic ? effect->num_stops : effect->num_stops - 1;
+    struct color ret = effect->stops[0];
+    if (segments > 0)
+    {
+        double position = x * segments;
+        int index = (int)position;
+        if (index >= segments)
+            index = segments - 1;
+        double f = position - index;
+
+        struct color a = effect->stops[index];
+        struct color b = effect->stops[(index + 1) % effect->num_stops];
+        ret = make_color(a.red + (b.red - a.red) * f, a.green + (b.green - a.green) * f, a.blue + (b.blue - a.blue) * f);
+    }
+    ret.profile = custom;
+    return ret;
+}
+
+/**
+ * @brief converts a hue (0 to 1) at full saturation and value into a color
+ */
+static struct color hue_to_color(double hue)
+{
+    double h = hue * 6;
+    int sector = (int)h % 6;
+    double f = h - floor(h);
+    struct color ret;
+    switch (sector)
+    {
+        case 0:  ret = make_color(255, 255 * f, 0);       break;
+        case 1:  ret = make_color(255 * (1 - f), 255, 0); break;
+        case 2:  ret = make_color(0, 255, 255 * f);       break;
+        case 3:  ret = make_color(0, 255 * (1 - f), 255); break;
+        case 4:  ret = make_color(255 * f, 0, 255);       break;
+        default: ret = make_color(255, 0, 255 * (1 - f)); break;
+    }
+    return ret;
+}
+
+/**
+ * @brief computes the color at position p (0 to 1) of the effect's table
+ */
+static struct color table_entry(const struct effect* effect, double p)
+{
+    struct color ret;
+    switch (effect->type)
+    {
+        case effect_breathe: //one breath per color stop
+            {
+                double position = p * effect->num_stops;
+                int index = (int)position;
+                double s = sin(M_PI * (position - index));
+                ret = scale_color(effect->stops[index], s * s);
+            }
+            break;
+
+        case effect_wave:
+            if (effect->num_stops > 1)
+                ret = gradient_at(effect, p, true);
+            else
+                ret = scale_color(effect->stops[0], 0.5 + 0.5 * cos(2 * M_PI * p));
+            break;
+
+        case effect_rainbow:
+            ret = hue_to_color(p);
+            break;
+
+        case effect_comet: //the head is at p = 0, the tail fades out over half a period
+            {
+                double tail = p < 0.5 ? 1 - 2 * p : 0;
+                ret = scale_color(gradient_at(effect, p < 0.5 ? 2 * p : 1, false), tail * tail);
+            }
+            break;
+
+        case effect_sweep: //back and forth through the gradient
+            ret = gradient_at(effect, 1 - fabs(2 * p - 1), false);
+            break;
+
+        default: //strobe: one short flash per color stop
+            {
+                double position = p * effect->num_stops;
+                int index = (int)position;
+                ret = position - index < 0.15 ? effect->stops[index] : make_color(0, 0, 0);
+            }
+            break;
+    }
+    ret.profile = custom;
+    return ret;
+}
+
+enum effect_type parse_effect(const char* effect_str)
+{
+    enum effect_type ret = -1;
+    if (effect_str != NULL)
+    {
+        switch (effect_str[0])
+        {
+            case 'b':
+                if (strcmp(effect_str, "breathe") == 0)
+                    ret = effect_breathe;
+                break;
+
+            case 'c':
+                if (strcmp(effect_str, "comet") == 0)
+                    ret = effect_comet;
+                break;
+
+            case 'r':
+                if (strcmp(effect_str, "rainbow") == 0)
+                    ret = effect_rainbow;
+                break;
+
+            case 's':
+                if (strcmp(effect_str, "sweep") == 0)
+                    ret = effect_sweep;
+                else if (strcmp(effect_str, "strobe") == 0)
+                    ret = effect_strobe;
+                break;
+
+            case 'w':
+                if (strcmp(effect_str, "wave") == 0)
+                    ret = effect_wave;
+                break;
+        }
+    }
+    return ret;
+}
+
+int effect_init(struct effect* effect, enum effect_type type, const struct color* stops, int num_stops, double period, int direction, double phase_offset, int num_regions)
+{
+    int ret = -1;
+    if ((int)type >= effect_breathe && type <= effect_strobe && num_stops >= 0 && num_stops <= EFFECT_MAX_STOPS &&
+        period > 0 && (direction == 1 || direction == -1) && num_regions > 0 && num_regions <= EFFECT_MAX_REGIONS)
+    {
+        effect->type = type;
+        effect->period = period;
+        effect->direction = direction;
+
+        if (num_stops > 0)
+        {
+            memcpy(effect->stops, stops, num_stops * sizeof(struct color));
+            effect->num_stops = num_stops;
+        }
+        else
+        {
+            effect->stops[0] = make_color(255, 255, 255);
+            effect->num_stops = 1;
+        }
+
+        //breathe and strobe show the color stops one after another, so their table spans one period per stop
+        effect->cycle = (type == effect_breathe || type == effect_strobe) ? period * effect->num_stops : period;
+
+        //by default, traveling effects spread one period over all regions while the others are synchronous
+        if (phase_offset < 0)
+        {
+            if (type == effect_breathe || type == effect_strobe)
+                phase_offset = 0;
+            else if (type == effect_sweep)
+                phase_offset = 0.5 / num_regions;
+            else
+                phase_offset = 1.0 / num_regions;
+        }
+        effect->phase_offset = phase_offset;
+
+        //the phase is a 32 bit fixed-point fraction of the cycle; region i lags behind the left one by i times the offset (scaled to the cycle)
+        //the reversed direction mirrors the regions, i.e. the right one leads, while the waveform itself still runs forward in time
+        for (int i=0; i<EFFECT_MAX_REGIONS; ++i)
+        {
+            int lag = direction > 0 || i >= num_regions ? i : num_regions - 1 - i;
+            double offset = lag * phase_offset * period / effect->cycle;
+            offset -= floor(offset);
+            effect->offsets[i] = (uint32_t)(0 - (uint64_t)(offset * 4294967296.0));
+        }
+
+        for (int i=0; i<EFFECT_TABLE_SIZE; ++i)
+            effect->table[i] = table_entry(effect, (double)i / EFFECT_TABLE_SIZE);
+        ret = 0;
+    }
+    return ret;
+}
+
+void effect_render_at(const struct effect* effect, struct color* frame, int num_regions, double t)
+{
+    double cycles = t / effect->cycle;
+    cycles -= floor(cycles);
+    uint32_t phase = (uint32_t)(uint64_t)(cycles * 4294967296.0);
+
+    for (int i=0; i<num_regions; ++i)
+        frame[i] = effect->table[(uint32_t)(phase + effect->offsets[i]) >> (32 - EFFECT_TABLE_BITS)];
+}
+
+int effect_render(void* context, struct color* frame, int num_regions, double t, double dt)
+{
+    (void)dt;
+    effect_render_at((const struct effect*)context, frame, num_regions, t);
+    return 0;
+}
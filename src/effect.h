@@ -0,0 +1,91 @@
+/**
+ * @file effect.h
+ *
+ * @brief header file for the parameterized software effects (software equivalents of the firmware modes and additional ones)
+ */
+
+#ifndef EFFECT_H
+#define EFFECT_H
+
+#include <stdint.h>
+#include "msiklm.h"
+
+#define EFFECT_TABLE_BITS 10
+#define EFFECT_TABLE_SIZE (1 << EFFECT_TABLE_BITS)
+#define EFFECT_MAX_STOPS  8
+#define EFFECT_MAX_REGIONS 7
+
+/**
+ * @brief effect type enum: each value refers to a software effect
+ */
+enum effect_type
+{
+    effect_breathe = 0, //all regions fade in and out through the gradient
+    effect_wave    = 1, //the gradient travels across the regions with a soft intensity wave
+    effect_rainbow = 2, //the full hue circle travels across the regions (the gradient is ignored)
+    effect_comet   = 3, //a bright head with a fading tail runs across the regions
+    effect_sweep   = 4, //the regions sweep back and forth through the (non-cyclic) gradient
+    effect_strobe  = 5  //short flashes of the gradient's colors
+};
+
+/**
+ * @brief effect struct: the effect's parameters and its precomputed lookup tables
+ *
+ * The whole waveform of one period (including the gradient) is precomputed into a color table, hence
+ * rendering a frame only requires to compute a single phase and to index the table once per region.
+ */
+struct effect
+{
+    enum effect_type type;
+    double period;                           //duration of one cycle in seconds
+    double cycle;                            //duration of the whole table in seconds (breathe and strobe use one cycle per color stop)
+    int direction;                           //1 moves from left to right, -1 from right to left
+    double phase_offset;                     //phase offset between two neighbouring regions as fraction of a period
+    int num_stops;
+    struct color stops[EFFECT_MAX_STOPS];    //the gradient's color stops
+    uint32_t offsets[EFFECT_MAX_REGIONS];    //precomputed fixed-point phase offset of each region
+    struct color table[EFFECT_TABLE_SIZE];   //precomputed colors of one period
+};
+
+/**
+ * @brief parses a string into an effect type
+ * @param effect_str the effect as a string (breathe, wave, rainbow, comet, sweep, strobe)
+ * @returns the parsed effect type or -1 if the string is not a valid effect
+ */
+enum effect_type parse_effect(const char* effect_str);
+
+/**
+ * @brief initializes an effect and precomputes its lookup tables
+ * @param effect the effect to initialize
+ * @param type the effect type
+ * @param stops the gradient's color stops (if there are none, white is used)
+ * @param num_stops the number of color stops (at most EFFECT_MAX_STOPS)
+ * @param period duration of one cycle in seconds
+ * @param direction 1 for left to right, -1 for right to left
+ * @param phase_offset phase offset between two neighbouring regions as fraction of a period, a negative value selects the effect's default
+ * @param num_regions the number of regions that will be rendered (required for the default phase offset and to mirror the regions of the reversed direction)
+ * @returns 0 on success, -1 on invalid parameters
+ */
+int effect_init(struct effect* effect, enum effect_type type, const struct color* stops, int num_stops, double period, int direction, double phase_offset, int num_regions);
+
+/**
+ * @brief renders the effect at the given time; rendering is deterministic, i.e. the same time always results in the same frame
+ * @param effect the effect
+ * @param frame the frame to render into
+ * @param num_regions the number of regions in the frame (at most EFFECT_MAX_REGIONS)
+ * @param t the time in seconds
+ */
+void effect_render_at(const struct effect* effect, struct color* frame, int num_regions, double t);
+
+/**
+ * @brief render callback for the frame loop (compatible with render_callback of animation.h)
+ * @param context the effect
+ * @param frame the frame to render into
+ * @param num_regions the number of regions in the frame
+ * @param t the time in seconds since the animation started
+ * @param dt the time in seconds since the previous frame (unused)
+ * @returns always 0
+ */
+int effect_render(void* context, struct color* frame, int num_regions, double t, double dt);
+
+#endif //EFFECT_H
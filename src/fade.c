@@ -0,0 +1,252 @@
+/**
+ * @file fade.c
+ *
+ * @brief source file that contains the cross-fades between two color states
+ */
+
+#include "fade.h"
+#include "animation.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LINEAR_TABLE_SIZE 4096
+
+static bool tables_initialized = false;
+static float srgb_to_linear[256];
+static byte linear_to_srgb[LINEAR_TABLE_SIZE];
+
+/**
+ * @brief oklab struct: a color in the OKLab space
+ */
+struct oklab
+{
+    float l;
+    float a;
+    float b;
+};
+
+/**
+ * @brief precomputes the sRGB transfer-function tables (once)
+ */
+static void init_tables()
+{
+    if (!tables_initialized)
+    {
+        for (int i=0; i<256; ++i)
+        {
+            double c = i / 255.0;
+            srgb_to_linear[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        for (int i=0; i<LINEAR_TABLE_SIZE; ++i)
+        {
+            double c = (double)i / (LINEAR_TABLE_SIZE - 1);
+            double s = c <= 0.0031308 ? c * 12.92 : 1.055 * pow(c, 1 / 2.4) - 0.055;
+            linear_to_srgb[i] = (byte)(s * 255 + 0.5);
+        }
+        tables_initialized = true;
+    }
+}
+
+/**
+ * @brief converts a linear channel value (0 to 1, clamped) into an sRGB channel value using the table
+ */
+static byte encode_channel(float linear)
+{
+    int index = (int)(linear * (LINEAR_TABLE_SIZE - 1) + 0.5f);
+    return linear_to_srgb[index < 0 ? 0 : index >= LINEAR_TABLE_SIZE ? LINEAR_TABLE_SIZE - 1 : index];
+}
+
+/**
+ * @brief converts an sRGB color into OKLab
+ */
+static struct oklab to_oklab(struct color color)
+{
+    float r = srgb_to_linear[color.red];
+    float g = srgb_to_linear[color.green];
+    float b = srgb_to_linear[color.blue];
+
+    float l = cbrtf(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+    float m = cbrtf(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+    float s = cbrtf(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+    struct oklab ret;
+    ret.l = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+    ret.a = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+    ret.b = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+    return ret;
+}
+
+/**
+ * @brief interpolates two OKLab colors and converts the result into an sRGB color
+ */
+static struct color interpolate(const struct oklab* from, const struct oklab* to, float f)
+{
+    float lab_l = from->l + (to->l - from->l) * f;
+    float lab_a = from->a + (to->a - from->a) * f;
+    float lab_b = from->b + (to->b - from->b) * f;
+
+    float l = lab_l + 0.3963377774f * lab_a + 0.2158037573f * lab_b;
+    float m = lab_l - 0.1055613458f * lab_a - 0.0638541728f * lab_b;
+    float s = lab_l - 0.0894841775f * lab_a - 1.2914855480f * lab_b;
+    l = l * l * l;
+    m = m * m * m;
+    s = s * s * s;
+
+    struct color ret;
+    ret.profile = custom;
+    ret.red = encode_channel(4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s);
+    ret.green = encode_channel(-1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s);
+    ret.blue = encode_channel(-0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s);
+    return ret;
+}
+
+int fade(hid_device* dev, const struct color* from, const struct color* to, int num_regions, long duration_ms, struct fade_stats* stats)
+{
+    int ret = -1;
+    if (num_regions > 0 && num_regions <= FADE_MAX_REGIONS && duration_ms >= 0)
+    {
+        struct fade_stats local_stats;
+        if (stats == NULL)
+            stats = &local_stats;
+        memset(stats, 0, sizeof(struct fade_stats));
+        init_tables();
+
+        //the endpoints are converted once, the keyboard is assumed to show the source colors already
+        struct oklab from_lab[FADE_MAX_REGIONS];
+        struct oklab to_lab[FADE_MAX_REGIONS];
+        struct color sent[FADE_MAX_REGIONS];
+        for (int i=0; i<num_regions; ++i)
+        {
+            from_lab[i] = to_oklab(from[i]);
+            to_lab[i] = to_oklab(to[i]);
+            sent[i] = from[i];
+        }
+
+        struct timespec start, end, now, deadline;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        end = start;
+        timespec_advance(&end, duration_ms * 1000000L);
+        deadline = start;
+        double duration = duration_ms / 1000.0;
+        double latency = 0;
+        double total_latency = 0;
+        int sending_steps = 0;
+        bool finished = false;
+        ret = 0;
+
+        while (ret == 0 && !finished)
+        {
+            //the progress is derived from the time, so late steps never delay the end of the fade
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double elapsed = timespec_seconds_between(&start, &now);
+            finished = elapsed >= duration;
+            float f = finished ? 1.0f : (float)(elapsed / duration);
+
+            int reports = 0;
+            for (int i=0; i<num_regions && ret == 0; ++i)
+            {
+                struct color color = finished ? to[i] : interpolate(&from_lab[i], &to_lab[i], f);
+                if (color.red != sent[i].red || color.green != sent[i].green || color.blue != sent[i].blue)
+                {
+                    int length = set_color(dev, color, i+1, rgb);
+                    if (length >= 0) //nothing is sent for regions the keyboard does not have
+                    {
+                        sent[i] = color;
+                        if (length > 0)
+                            ++reports;
+                    }
+                    else
+                    {
+                        ret = -1;
+                    }
+                }
+            }
+            if (ret == 0 && reports > 0 && set_mode(dev, normal) <= 0)
+                ret = -1;
+            ++stats->steps;
+
+            if (ret == 0 && reports > 0)
+            {
+                stats->reports += reports + 1;
+
+                //track the latency of a step (exponential moving average) to adapt the step interval
+                struct timespec sent_time;
+                clock_gettime(CLOCK_MONOTONIC, &sent_time);
+                double sample = timespec_seconds_between(&now, &sent_time);
+                latency = sending_steps == 0 ? sample : 0.8 * latency + 0.2 * sample;
+                total_latency += sample;
+                ++sending_steps;
+            }
+
+            if (!finished)
+            {
+                //the next step is due after the sustainable interval or the measured latency (whichever is longer), but never after the end
+                long interval = (long)(latency * 1e9);
+                if (interval < FADE_MIN_INTERVAL)
+                    interval = FADE_MIN_INTERVAL;
+                timespec_advance(&deadline, interval);
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (timespec_seconds_between(&now, &deadline) < 0)
+                    deadline = now;
+                if (timespec_seconds_between(&deadline, &end) < 0)
+                    deadline = end;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+            }
+            else
+            {
+                stats->lateness = timespec_seconds_between(&end, &now);
+            }
+        }
+
+        if (sending_steps > 0)
+            stats->latency = total_latency / sending_steps;
+    }
+    return ret;
+}
+
+int fade_load_state(const char* path, struct color* colors, int* num_regions)
+{
+    int ret = -1;
+    FILE* file = fopen(path, "r");
+    if (file != NULL)
+    {
+        char line[256];
+        if (fgets(line, sizeof(line), file) != NULL)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            ret = parse_color_list(line, colors, FADE_MAX_REGIONS, num_regions);
+        }
+        fclose(file);
+    }
+    return ret;
+}
+
+int fade_save_state(const char* path, const struct color* colors, int num_regions)
+{
+    int ret = -1;
+    struct color state[FADE_MAX_REGIONS];
+    int num_state = 0;
+    if (fade_load_state(path, state, &num_state) != 0)
+        num_state = 0;
+
+    for (int i=0; i<num_regions && i<FADE_MAX_REGIONS; ++i)
+        state[i] = colors[i];
+    if (num_regions > num_state)
+        num_state = num_regions < FADE_MAX_REGIONS ? num_regions : FADE_MAX_REGIONS;
+
+    //the state is stored in the command line notation, so it can be parsed like any other color list
+    FILE* file = fopen(path, "w");
+    if (file != NULL)
+    {
+        ret = 0;
+        for (int i=0; i<num_state; ++i)
+            if (fprintf(file, "%s[%d;%d;%d]", i > 0 ? "," : "", state[i].red, state[i].green, state[i].blue) < 0)
+                ret = -1;
+        fprintf(file, "\n");
+        if (fclose(file) != 0)
+            ret = -1;
+    }
+    return ret;
+}
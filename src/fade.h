@@ -0,0 +1,62 @@
+/**
+ * @file fade.h
+ *
+ * @brief header file for smooth cross-fades between two color states
+ *
+ * The colors are interpolated in the perceptually uniform OKLab space; the conversions from and to
+ * sRGB use precomputed transfer-function tables. The fade is paced at the keyboard's sustainable
+ * report rate and the time between two steps adapts to the measured report latency, such that the
+ * fade always ends on time while sending only the regions that changed in each step.
+ */
+
+#ifndef FADE_H
+#define FADE_H
+
+#include "msiklm.h"
+
+#define FADE_MAX_REGIONS  7
+#define FADE_MIN_INTERVAL 20000000L //minimal time between two steps in nanoseconds (the keyboard's sustainable rate)
+#define FADE_STATE_PATH   "/var/run/msiklm.state"
+
+/**
+ * @brief fade statistics struct: what a fade actually did
+ */
+struct fade_stats
+{
+    int steps;                     //number of rendered steps
+    int reports;                   //number of sent feature reports
+    double latency;                //average latency of a step's reports in seconds
+    double lateness;               //delay between the requested and the actual end of the fade in seconds
+};
+
+/**
+ * @brief fades from one color state to another within the given time (the colors are committed with the normal mode in each step)
+ * @param dev the hid device
+ * @param from the current colors
+ * @param to the target colors
+ * @param num_regions the number of regions, starting with the left one
+ * @param duration_ms the duration of the fade in milliseconds
+ * @param stats the statistics of the fade (might be null)
+ * @returns 0 on success, -1 on error
+ */
+int fade(hid_device* dev, const struct color* from, const struct color* to, int num_regions, long duration_ms, struct fade_stats* stats);
+
+/**
+ * @brief loads the last applied colors
+ * @param path the path of the state file (normally FADE_STATE_PATH)
+ * @param colors the last applied colors (at least FADE_MAX_REGIONS)
+ * @param num_regions the number of known regions, starting with the left one
+ * @returns 0 on success, -1 if there is no (valid) state
+ */
+int fade_load_state(const char* path, struct color* colors, int* num_regions);
+
+/**
+ * @brief saves the applied colors; regions that have not been applied keep their previously saved colors
+ * @param path the path of the state file (normally FADE_STATE_PATH)
+ * @param colors the applied colors
+ * @param num_regions the number of applied regions, starting with the left one
+ * @returns 0 on success, -1 on error
+ */
+int fade_save_state(const char* path, const struct color* colors, int num_regions);
+
+#endif //FADE_H
@@ -7,7 +7,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "msiklm.h"
+#include "animation.h"
+#include "effect.h"
+#include "fade.h"
+#include "plugin.h"
+#include "procwatch.h"
+#include "protocol.h"
+#include "schedule.h"
+#include "shared.h"
+#include "sim.h"
+#include "timeline.h"
 
 //the following macros can be used for colored text output
 #ifndef _WIN32
@@ -98,6 +109,89 @@ void show_help()
             "<mode>\n"
            KDEFAULT
             "    only set a mode and keep the colors unchanged\n"
+            "\n"
+           KMAG
+            "--fade <ms>\n"
+           KDEFAULT
+            "    can be added to any of the color commands above to smoothly fade from the last applied colors to the new ones\n"
+            "    within the given time in milliseconds (only for colors without an explicit brightness)\n"
+            "\n"
+           KMAG
+            "effect <effect> [<colors>] [--period <s>] [--direction <left|right>] [--phase <f>] [<animation options>]\n"
+           KDEFAULT
+            "    runs a software effect until interrupted; effect is one of: breathe, wave, rainbow, comet, sweep, strobe\n"
+            "    the colors (same format as above, at most 8) define the effect's gradient, the period is the duration of one cycle in seconds\n"
+            "    (default: 2), the phase is the offset between two neighbouring regions as a fraction of the period\n"
+            "\n"
+           KMAG
+            "plugin <file> [--budget <us>] [<animation options>]\n"
+           KDEFAULT
+            "    runs the effect plugin (shared library) in the given file until interrupted;\n"
+            "    plugins exceeding their render-time budget (default: a quarter of the frame interval) are reported and eventually stopped\n"
+            "\n"
+           KMAG
+            "publish <colors> [<brightness>] [<mode>]\n"
+           KDEFAULT
+            "    publishes the colors (same arguments as above) to the shared state /dev/shm/msiklm instead of sending them directly;\n"
+            "    any number of processes might publish concurrently, a single flusher sends the changes to the keyboard\n"
+            "\n"
+           KMAG
+            "keys <key>=<color>[,<key>=<color>...]\n"
+           KDEFAULT
+            "    sets the colors of individual keys of a per-key keyboard, e.g. 'keys 0x04=red,0x05=0x00FF00'; the key is its HID usage ID\n"
+            "    (decimal or hex) and all keys are sent in as few reports as possible\n"
+            "\n"
+           KMAG
+            "flush [--fps <n>]\n"
+           KDEFAULT
+            "    runs the flusher that checks the shared state n times per second (default: 60) and sends only changed regions until interrupted\n"
+            "\n"
+           KMAG
+            "schedule <file>\n"
+           KDEFAULT
+            "    applies the time-of-day schedule in the given file until interrupted; each line has the format\n"
+            "    <HH:MM> <colors> [<transition minutes>], e.g. '22:00 0xFFB060 30' fades to warm white within 30 minutes after 22:00\n"
+            "\n"
+           KMAG
+            "watch <file>\n"
+           KDEFAULT
+            "    applies per-application profiles until interrupted; each line of the file has the format\n"
+            "    <executable> <colors> [<brightness>] [<mode>], e.g. 'steam red' while steam is running; the executable 'default'\n"
+            "    defines the profile that is used while none of the other programs is running (requires root for the process connector)\n"
+            "\n"
+           KMAG
+            "compile <script> <file> [--fps <n>] [--regions <n>] [--threads <n>] [--protocol <region|per-key>]\n"
+           KDEFAULT
+            "    pre-renders the light show in the script into a timeline file (no keyboard required); each line of the script has\n"
+            "    the format <seconds> <effect> [<colors>] [<period>] or <seconds> <colors>, the segments are played one after another;\n"
+            "    by default, 30 fps, three regions, one thread per CPU and the MSI region protocol are used (the timeline can only be played\n"
+            "    on keyboards with the protocol it was compiled for)\n"
+            "\n"
+           KMAG
+            "play <file> [--loop]\n"
+           KDEFAULT
+            "    plays a compiled timeline file until it ends (or until interrupted if it is looped)\n"
+            "\n"
+           KMAG
+            "<animation options>\n"
+           KDEFAULT
+            "    --fps <n>            frame rate on AC power (default: 30)\n"
+            "    --battery-fps <n>    frame rate on battery; 0 uses the firmware battery mode instead (default: 0)\n"
+            "    --battery-mode <m>   firmware mode used on battery if the battery frame rate is 0 (default: breathe)\n"
+            "    --idle <s>           seconds without input until the keyboard is released; 0 never releases it (default: 300)\n"
+            "    --regions <n>        number of animated regions, starting with the left one (default: 3)\n"
+            "    --duration <s>       stops the animation after the given number of seconds (default: run until interrupted)\n"
+            "    --realtime <p>       runs the frame loop with the real-time policy fifo or rr and locks its memory (requires root)\n"
+            "    --priority <n>       real-time priority from 1 to 99 (default: 50)\n"
+            "    --cpu <n>            pins the frame loop to the given CPU\n"
+            "    --jitter             prints a histogram of the delays between the frame deadlines and the actual send times\n"
+            "\n"
+           KMAG
+            "MSIKLM_SIM=[latency=<us>][,rate=<n>][,preview]\n"
+           KDEFAULT
+            "    environment variable that replaces the keyboard by a simulated one for all commands (no root required);\n"
+            "    each report blocks for the latency (default: 1000), at most rate reports per second are accepted (default: 250)\n"
+            "    and preview shows the committed colors in the terminal; the received, rejected and coalesced reports are printed on exit\n"
     );
 }
 
@@ -153,6 +247,9 @@ void enumerate_hid()
             printf("    Device Path:             %s\n", dev->path);
             printf("    Device Interface Number: %i\n", dev->interface_number);
             printf("    Device Release Number:   %d\n", dev->release_number);
+            const struct device* device = find_device(dev->vendor_id, dev->product_id);
+            printf("    Supported by MSIKLM:     %s%s\n", device != NULL ? device->protocol->name : "no",
+                   device != NULL && !device->verified ? " (unverified, only used if " PROTOCOL_UNVERIFIED_ENV " is set)" : "");
             printf("\n");
             dev = dev->next;
         }
@@ -165,54 +262,778 @@ void enumerate_hid()
 }
 
 /**
- * @brief application's entry point
+ * @brief parses an integer argument within the given limits
+ * @param value_str the integer value as a string (might be null)
+ * @param min the minimal valid value
+ * @param max the maximal valid value
+ * @param result the parsed value
+ * @returns 0 if parsing succeeded, -1 on error
+ */
+int parse_int(const char* value_str, int min, int max, int* result)
+{
+    int ret = -1;
+    if (value_str != NULL)
+    {
+        char* end_ptr = NULL;
+        long val = strtol(value_str, &end_ptr, 10);
+        if (end_ptr != value_str && *end_ptr == '\0' && val >= min && val <= max)
+        {
+            *result = (int)val;
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief loads the last applied colors as the starting point of a fade; the simulated keyboard provides its committed state instead of the state file
+ * @param dev the hid device
+ * @param colors the last applied colors (at least FADE_MAX_REGIONS)
+ * @param num_regions the number of known regions, starting with the left one
+ * @returns 0 on success, -1 if the last applied colors are unknown
+ */
+int load_applied_colors(hid_device* dev, struct color* colors, int* num_regions)
+{
+    int ret = 0;
+    if (sim_is_device(dev))
+    {
+        enum mode mode;
+        struct color committed[SIM_NUM_REGIONS];
+        sim_get_state(committed, &mode);
+        *num_regions = SIM_NUM_REGIONS < FADE_MAX_REGIONS ? SIM_NUM_REGIONS : FADE_MAX_REGIONS;
+        memcpy(colors, committed, *num_regions * sizeof(struct color));
+    }
+    else
+    {
+        ret = fade_load_state(FADE_STATE_PATH, colors, num_regions);
+    }
+    return ret;
+}
+
+/**
+ * @brief removes the fade option (--fade <ms>) from the command line arguments
  * @param argc number of command line arguments
- * @param argv command line argument array; the first value is always the program's name
- * @return 0 if everything succeeded, -1 otherwise
+ * @param argv command line argument array; the option and its value are removed in place
+ * @param fade_ms the parsed fade duration in milliseconds (unchanged if there is no fade option)
+ * @returns the remaining number of command line arguments, -1 if the fade duration is invalid
  */
-int main(int argc, char** argv)
+int extract_fade_option(int argc, char** argv, int* fade_ms)
 {
-    //the color values (at most 7); num_regions tracks the actual number of parsed colors (i.e. regions to set) while with_rgb indicates if there is any rgb-color used
-    struct color colors[7];
-    int num_regions = 0;
-    bool with_rgb = false;
-    int ret = argc > 1 ? hid_init() : -1;
+    int ret = argc;
+    for (int i=1; i<ret && ret >= 0; ++i)
+    {
+        if (strcmp(argv[i], "--fade") == 0)
+        {
+            if (parse_int(i+1 < ret ? argv[i+1] : NULL, 0, 3600000, fade_ms) == 0)
+            {
+                for (int j=i+2; j<ret; ++j)
+                    argv[j-2] = argv[j];
+                ret -= 2;
+                --i;
+            }
+            else
+            {
+                on_parse_error(i+1 < ret ? argv[i+1] : argv[i], "fade duration");
+                ret = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief parses a floating-point argument within the given limits
+ * @param value_str the value as a string (might be null)
+ * @param min the minimal valid value
+ * @param max the maximal valid value
+ * @param result the parsed value
+ * @returns 0 if parsing succeeded, -1 on error
+ */
+int parse_double(const char* value_str, double min, double max, double* result)
+{
+    int ret = -1;
+    if (value_str != NULL)
+    {
+        char* end_ptr = NULL;
+        double val = strtod(value_str, &end_ptr);
+        if (end_ptr != value_str && *end_ptr == '\0' && val >= min && val <= max)
+        {
+            *result = val;
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief parses a single animation option (cf. show_help()) at the given position
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param index the position of the option
+ * @param options the animation options to update
+ * @returns the number of consumed arguments, 0 if it is no animation option or -1 if its value is invalid
+ */
+int parse_animation_option(int argc, char** argv, int index, struct animation_options* options)
+{
+    int ret = 0;
+    const char* option = argv[index];
+    const char* value = index+1 < argc ? argv[index+1] : NULL;
+
+    if (strcmp(option, "--fps") == 0)
+        ret = parse_int(value, 1, 1000, &options->policy.fps_ac) == 0 ? 2 : -1;
+    else if (strcmp(option, "--battery-fps") == 0)
+        ret = parse_int(value, 0, 1000, &options->policy.fps_battery) == 0 ? 2 : -1;
+    else if (strcmp(option, "--battery-mode") == 0)
+        ret = (int)(options->policy.battery_mode = parse_mode(value)) >= 0 ? 2 : -1;
+    else if (strcmp(option, "--idle") == 0)
+        ret = parse_int(value, 0, 86400, &options->policy.idle_timeout) == 0 ? 2 : -1;
+    else if (strcmp(option, "--regions") == 0)
+        ret = parse_int(value, 1, ANIMATION_MAX_REGIONS, &options->num_regions) == 0 ? 2 : -1;
+    else if (strcmp(option, "--duration") == 0)
+        ret = parse_double(value, 0, 86400, &options->duration) == 0 ? 2 : -1;
+    else if (strcmp(option, "--realtime") == 0)
+    {
+        options->realtime.lock_memory = true; //the real-time profile always includes memory locking
+        ret = (int)(options->realtime.policy = parse_realtime_policy(value)) >= 0 ? 2 : -1;
+    }
+    else if (strcmp(option, "--priority") == 0)
+        ret = parse_int(value, 1, 99, &options->realtime.priority) == 0 ? 2 : -1;
+    else if (strcmp(option, "--cpu") == 0)
+        ret = parse_int(value, 0, 1023, &options->realtime.cpu) == 0 ? 2 : -1;
+    else if (strcmp(option, "--jitter") == 0)
+    {
+        options->jitter = true;
+        ret = 1;
+    }
+
+    if (ret < 0)
+        on_parse_error(value != NULL ? value : option, option);
+    return ret;
+}
+
+/**
+ * @brief opens the keyboard and runs an animation on it
+ * @param render the render callback
+ * @param context the render callback's context
+ * @param options the animation options
+ * @returns 0 if the animation finished or was interrupted, -1 on error
+ */
+int run_animation(render_callback render, void* context, const struct animation_options* options)
+{
+    int ret = -1;
+    hid_device* dev = open_keyboard();
+    if (dev != NULL)
+    {
+        ret = animate(&dev, render, context, options);
+        if (dev != NULL)
+            close_keyboard(dev);
+    }
+    else
+    {
+        printf(KMAG
+            "No compatible keyboard found!\n"
+            KDEFAULT
+            "Check you're using sudo!\n");
+    }
+    return ret;
+}
+
+/**
+ * @brief runs an effect plugin: plugin <file> [--budget <us>] [<animation options>]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_plugin(int argc, char** argv)
+{
+    int ret = argc > 0 ? 0 : -1;
+    int budget_us = -1;
+    struct animation_options options;
+    animation_options_init(&options);
+
+    for (int i=1; i<argc && ret == 0; )
+    {
+        int consumed = 0;
+        if (strcmp(argv[i], "--budget") == 0)
+        {
+            consumed = parse_int(i+1 < argc ? argv[i+1] : NULL, 0, 1000000, &budget_us) == 0 ? 2 : -1;
+            if (consumed < 0)
+                on_parse_error(i+1 < argc ? argv[i+1] : argv[i], "budget");
+        }
+        else if ((consumed = parse_animation_option(argc, argv, i, &options)) == 0)
+        {
+            on_parse_error(argv[i], "plugin option");
+            consumed = -1;
+        }
+
+        if (consumed > 0)
+            i += consumed;
+        else
+            ret = -1;
+    }
 
-    //if colors are supplied, they are always the first argument, so try to parse them
     if (ret == 0)
     {
-        size_t length = strlen(argv[1]);
-        char* color_arg = (char*)malloc((length+1) * sizeof(char));
-        if (color_arg != NULL)
+        long budget_ns = budget_us >= 0 ? budget_us * 1000L : 1000000000L / options.policy.fps_ac / 4;
+        struct plugin plugin;
+        ret = plugin_load(&plugin, argv[0], options.num_regions, budget_ns);
+        if (ret == 0)
         {
-            strcpy(color_arg, argv[1]);
-            color_arg[length] = '\0';
+            ret = run_animation(plugin_render, &plugin, &options);
+            plugin_unload(&plugin);
+        }
+    }
+    else if (argc == 0)
+    {
+        on_parse_error(NULL, NULL);
+    }
+    return ret;
+}
 
-            char* saved_ptr = NULL;
-            const char* color_str = strtok_r(color_arg, ",", &saved_ptr);
-            while (color_str != NULL && ret == 0) //parse into next color slot as long as a color is available for parsing (color_str != NULL) and previous parsing succeeded (ret == 0)
+/**
+ * @brief runs a software effect: effect <name> [<colors>] [--period <s>] [--direction <left|right>] [--phase <f>] [<animation options>]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_effect(int argc, char** argv)
+{
+    int ret = -1;
+    enum effect_type type = parse_effect(argc > 0 ? argv[0] : NULL);
+    struct color stops[EFFECT_MAX_STOPS];
+    int num_stops = 0;
+    double period = 2;
+    double phase_offset = -1;
+    int direction = 1;
+    struct animation_options options;
+    animation_options_init(&options);
+
+    if ((int)type >= 0)
+    {
+        ret = 0;
+        int i = 1;
+        if (i < argc && argv[i][0] != '-' && (ret = parse_color_list(argv[i++], stops, EFFECT_MAX_STOPS, &num_stops)) != 0)
+            on_parse_error(argv[i-1], "color");
+
+        while (i < argc && ret == 0)
+        {
+            const char* value = i+1 < argc ? argv[i+1] : NULL;
+            int consumed = 2;
+            if (strcmp(argv[i], "--period") == 0)
+                ret = parse_double(value, 0.01, 3600, &period);
+            else if (strcmp(argv[i], "--phase") == 0)
+                ret = parse_double(value, 0, 1, &phase_offset);
+            else if (strcmp(argv[i], "--direction") == 0)
             {
-                if (num_regions < 7 &&
-                    !(ret = parse_color(color_str, &(colors[num_regions]))))
-                {
-                    if (colors[num_regions].profile == custom)
-                        with_rgb = true;
-                    ++num_regions;
-                    color_str = strtok_r(NULL, ",", &saved_ptr);
-                }
+                if (value != NULL && strcmp(value, "left") == 0)
+                    direction = -1;
+                else if (value != NULL && strcmp(value, "right") == 0)
+                    direction = 1;
                 else
-                {
                     ret = -1;
-                }
             }
-            free(color_arg);
+            else if ((consumed = parse_animation_option(argc, argv, i, &options)) <= 0)
+            {
+                if (consumed == 0)
+                    on_parse_error(argv[i], "effect option");
+                ret = -1;
+                consumed = 0;
+            }
+
+            if (ret != 0 && consumed == 2)
+                on_parse_error(value != NULL ? value : argv[i], argv[i]);
+            i += consumed;
+        }
+    }
+    else
+    {
+        on_parse_error(argc > 0 ? argv[0] : NULL, "effect");
+    }
+
+    if (ret == 0)
+    {
+        struct effect* effect = (struct effect*)malloc(sizeof(struct effect));
+        if (effect != NULL && effect_init(effect, type, stops, num_stops, period, direction, phase_offset, options.num_regions) == 0)
+            ret = run_animation(effect_render, effect, &options);
+        else
+            ret = -1;
+        free(effect);
+    }
+    return ret;
+}
+
+/**
+ * @brief parses a list of key colors in the format <key>=<color>[,<key>=<color>...] where the key is its HID usage ID (decimal or hex)
+ * @param keys_str the key colors as a string
+ * @param keys the parsed key colors (at least 256)
+ * @param num_keys the number of parsed key colors
+ * @returns 0 on success, -1 if any key or color is invalid
+ */
+int parse_key_colors(const char* keys_str, struct key_color* keys, int* num_keys)
+{
+    int ret = 0;
+    char buffer[4096];
+    *num_keys = 0;
+    if (snprintf(buffer, sizeof(buffer), "%s", keys_str) >= (int)sizeof(buffer))
+        ret = -1;
+
+    char* save_ptr = NULL;
+    for (char* key_str = strtok_r(buffer, ",", &save_ptr); key_str != NULL && ret == 0; key_str = strtok_r(NULL, ",", &save_ptr))
+    {
+        char* end_ptr = NULL;
+        long key = strtol(key_str, &end_ptr, 0);
+        struct color color;
+        if (end_ptr != key_str && *end_ptr == '=' && key >= 0 && key <= 255 && *num_keys < 256 && parse_color(end_ptr + 1, &color) == 0)
+        {
+            keys[*num_keys].key = (byte)key;
+            keys[*num_keys].red = color.red;
+            keys[*num_keys].green = color.green;
+            keys[*num_keys].blue = color.blue;
+            ++(*num_keys);
+        }
+        else
+        {
+            on_parse_error(key_str, "key color");
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief sets the colors of individual keys of a per-key keyboard: keys <key>=<color>[,<key>=<color>...]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_keys(int argc, char** argv)
+{
+    int ret = -1;
+    struct key_color keys[256];
+    int num_keys = 0;
+    if (argc == 1 && parse_key_colors(argv[0], keys, &num_keys) == 0)
+    {
+        hid_device* dev = open_keyboard();
+        if (dev != NULL)
+        {
+            //all keys are batched into as few reports as possible, the apply report makes them visible
+            if (set_keys(dev, keys, num_keys) >= 0 && set_mode(dev, normal) > 0)
+                ret = 0;
+            else
+                printf(KRED"The keyboard does not support per-key colors (%s protocol)\n"KDEFAULT, keyboard_protocol(dev)->name);
+            close_keyboard(dev);
+        }
+        else
+        {
+            printf(KMAG
+                "No compatible keyboard found!\n"
+                KDEFAULT
+                "Check you're using sudo!\n");
+        }
+    }
+    else if (argc != 1)
+    {
+        on_parse_error(argc > 1 ? argv[1] : NULL, argc > 1 ? "keys" : NULL);
+    }
+    return ret;
+}
+
+/**
+ * @brief publishes colors to the shared state: publish <colors> [<brightness>] [<mode>]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_publish(int argc, char** argv)
+{
+    int ret = -1;
+    struct color colors[SHARED_MAX_REGIONS];
+    int num_regions = 0;
+    enum brightness br = rgb;
+    enum mode md = normal;
+
+    if (argc >= 1 && argc <= 3 && (ret = parse_color_list(argv[0], colors, SHARED_MAX_REGIONS, &num_regions)) == 0)
+    {
+        bool with_rgb = false;
+        for (int i=0; i<num_regions; ++i)
+            if (colors[i].profile == custom)
+                with_rgb = true;
+
+        //same argument structure as the plain color command: an optional brightness followed by an optional mode
+        int i = 1;
+        if (i < argc && (int)parse_brightness(argv[i]) >= 0)
+        {
+            br = parse_check_brightness(argv[i++], with_rgb);
+            if ((int)br < 0)
+                ret = -1;
+        }
+        if (ret == 0 && i < argc)
+        {
+            md = parse_mode(argv[i]);
+            if ((int)md < 0)
+            {
+                on_parse_error(argv[i], "brightness / mode");
+                ret = -1;
+            }
+            else if (++i < argc)
+            {
+                on_parse_error(argv[i], NULL);
+                ret = -1;
+            }
+        }
+
+        if (ret == 0)
+        {
+            if (num_regions == 1 && md != gaming) //same special case as for the plain color command
+            {
+                colors[2] = colors[1] = colors[0];
+                num_regions = 3;
+            }
+
+            struct shared_state* state = shared_state_open();
+            if (state != NULL)
+            {
+                shared_state_publish(state, colors, num_regions, br, md);
+                shared_state_close(state);
+            }
+            else
+            {
+                printf(KRED"Shared state /dev/shm%s could not be opened\n"KDEFAULT, SHARED_STATE_NAME);
+                ret = -1;
+            }
+        }
+    }
+    else
+    {
+        on_parse_error(argc >= 1 ? argv[0] : NULL, argc >= 1 ? "color" : NULL);
+    }
+    return ret;
+}
+
+/**
+ * @brief runs the flusher that sends every change of the shared state to the keyboard: flush [--fps <n>]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_flush(int argc, char** argv)
+{
+    int ret = 0;
+    int fps = 60;
+    if (argc != 0 && (argc != 2 || strcmp(argv[0], "--fps") != 0 || parse_int(argv[1], 1, 1000, &fps) != 0))
+    {
+        on_parse_error(argc == 2 ? argv[1] : argv[0], "flush option");
+        ret = -1;
+    }
+
+    if (ret == 0)
+    {
+        struct shared_state* state = shared_state_open();
+        hid_device* dev = state != NULL ? open_keyboard() : NULL;
+        if (dev != NULL)
+        {
+            ret = shared_state_run_flusher(dev, state, fps);
+            close_keyboard(dev);
+        }
+        else
+        {
+            if (state == NULL)
+                printf(KRED"Shared state /dev/shm%s could not be opened\n"KDEFAULT, SHARED_STATE_NAME);
+            else
+                printf(KMAG
+                    "No compatible keyboard found!\n"
+                    KDEFAULT
+                    "Check you're using sudo!\n");
+            ret = -1;
+        }
+        shared_state_close(state);
+    }
+    return ret;
+}
+
+/**
+ * @brief runs a time-of-day schedule until interrupted: schedule <file>
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_schedule(int argc, char** argv)
+{
+    int ret = -1;
+    struct schedule* schedule = argc == 1 ? (struct schedule*)malloc(sizeof(struct schedule)) : NULL;
+    if (schedule != NULL)
+    {
+        int line = schedule_load(schedule, argv[0]);
+        if (line == 0)
+        {
+            struct schedule_clock clock;
+            hid_device* dev = open_keyboard();
+            if (dev != NULL && schedule_clock_init(&clock) == 0)
+            {
+                struct schedule_stats stats;
+                ret = schedule_run(dev, schedule, &clock, &stats);
+                schedule_clock_close(&clock);
+                printf("schedule: %lu wakeups, %lu reports, max. lateness %.3f ms\n", stats.wakeups, stats.reports, stats.max_lateness * 1000);
+            }
+            else if (dev == NULL)
+            {
+                printf(KMAG
+                    "No compatible keyboard found!\n"
+                    KDEFAULT
+                    "Check you're using sudo!\n");
+            }
+            if (dev != NULL)
+                close_keyboard(dev);
+        }
+        else if (line > 0)
+        {
+            printf(KRED"Invalid schedule entry in line %d of '%s' - expected <HH:MM> <colors> [<transition minutes>]\n"KDEFAULT, line, argv[0]);
+        }
+        else
+        {
+            printf(KRED"Schedule '%s' could not be read or contains no entries\n"KDEFAULT, argv[0]);
+        }
+        free(schedule);
+    }
+    else
+    {
+        on_parse_error(NULL, NULL);
+    }
+    return ret;
+}
+
+/**
+ * @brief switches between per-application profiles until interrupted: watch <file>
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_watch(int argc, char** argv)
+{
+    int ret = -1;
+    struct procwatch* watch = argc == 1 ? (struct procwatch*)malloc(sizeof(struct procwatch)) : NULL;
+    if (watch != NULL)
+    {
+        //the profiles are encoded for the detected keyboard's protocol, so the keyboard is opened first
+        hid_device* dev = open_keyboard();
+        if (dev != NULL)
+        {
+            int line = procwatch_load(watch, argv[0], keyboard_protocol(dev));
+            if (line == 0)
+            {
+                ret = procwatch_run(watch, dev);
+                if (ret != 0)
+                    printf(KRED"The process connector is not available or a profile could not be applied - check you're using sudo!\n"KDEFAULT);
+                printf("watch: %lu events, %lu profile switches, %.1f us per event\n", watch->events, watch->switches,
+                       watch->events > 0 ? (double)watch->handling_ns / watch->events / 1000 : 0.0);
+            }
+            else if (line > 0)
+            {
+                printf(KRED"Invalid profile in line %d of '%s' - expected <executable> <colors> [<brightness>] [<mode>]\n"KDEFAULT, line, argv[0]);
+            }
+            else
+            {
+                printf(KRED"Profiles '%s' could not be read or contain no entries\n"KDEFAULT, argv[0]);
+            }
+            close_keyboard(dev);
+        }
+        else
+        {
+            printf(KMAG
+                "No compatible keyboard found!\n"
+                KDEFAULT
+                "Check you're using sudo!\n");
+        }
+        free(watch);
+    }
+    else
+    {
+        on_parse_error(NULL, NULL);
+    }
+    return ret;
+}
+
+/**
+ * @brief compiles a timeline script into a timeline file: compile <script> <file> [--fps <n>] [--regions <n>] [--threads <n>] [--protocol <region|per-key>]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_compile(int argc, char** argv)
+{
+    int ret = argc >= 2 ? 0 : -1;
+    int fps = 30;
+    int num_regions = 3;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = cpus > 0 && cpus <= 256 ? (int)cpus : 1;
+    const struct protocol* protocol = &region_protocol;
+
+    for (int i=2; i<argc && ret == 0; i+=2)
+    {
+        const char* value = i+1 < argc ? argv[i+1] : NULL;
+        if (strcmp(argv[i], "--fps") == 0)
+            ret = parse_int(value, 1, 1000, &fps);
+        else if (strcmp(argv[i], "--regions") == 0)
+            ret = parse_int(value, 1, TIMELINE_MAX_REGIONS, &num_regions);
+        else if (strcmp(argv[i], "--threads") == 0)
+            ret = parse_int(value, 1, 256, &num_threads);
+        else if (strcmp(argv[i], "--protocol") == 0 && value != NULL && strcmp(value, "region") == 0)
+            protocol = &region_protocol;
+        else if (strcmp(argv[i], "--protocol") == 0 && value != NULL && strcmp(value, "per-key") == 0)
+            protocol = &per_key_protocol;
+        else
+            ret = -1;
+
+        if (ret != 0)
+            on_parse_error(value != NULL ? value : argv[i], "compile option");
+    }
+
+    struct timeline_script* script = ret == 0 ? (struct timeline_script*)malloc(sizeof(struct timeline_script)) : NULL;
+    if (script != NULL)
+    {
+        int line = timeline_load(script, argv[0], num_regions);
+        if (line == 0)
+        {
+            struct timeline_stats stats;
+            ret = timeline_compile(script, protocol, fps, num_threads, argv[1], &stats);
+            if (ret == 0)
+                printf("compile: %lu frames, %lu deltas, %llu bytes, %d threads, %lu steals, %.3f s (%.0f frames/s)\n", stats.frames, stats.deltas,
+                       stats.size, stats.threads, stats.steals, stats.seconds, stats.seconds > 0 ? stats.frames / stats.seconds : 0.0);
+            else
+                printf(KRED"Timeline '%s' could not be written (at most %d frames are supported)\n"KDEFAULT, argv[1], TIMELINE_MAX_FRAMES);
+        }
+        else if (line > 0)
+        {
+            printf(KRED"Invalid segment in line %d of '%s' - expected <seconds> <effect> [<colors>] [<period>] or <seconds> <colors>\n"KDEFAULT, line, argv[0]);
+            ret = -1;
         }
         else
         {
+            printf(KRED"Script '%s' could not be read or contains no segments\n"KDEFAULT, argv[0]);
             ret = -1;
         }
+        free(script);
+    }
+    else if (argc < 2)
+    {
+        on_parse_error(NULL, NULL);
+    }
+    else
+    {
+        ret = -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief plays a compiled timeline: play <file> [--loop]
+ * @param argc number of command arguments (without the command itself)
+ * @param argv the command arguments
+ * @returns 0 if everything succeeded, -1 otherwise
+ */
+int run_play(int argc, char** argv)
+{
+    int ret = -1;
+    if (argc == 1 || (argc == 2 && strcmp(argv[1], "--loop") == 0))
+    {
+        hid_device* dev = open_keyboard();
+        if (dev != NULL)
+        {
+            ret = timeline_play(dev, argv[0], argc == 2);
+            close_keyboard(dev);
+        }
+        else
+        {
+            printf(KMAG
+                "No compatible keyboard found!\n"
+                KDEFAULT
+                "Check you're using sudo!\n");
+        }
+    }
+    else
+    {
+        on_parse_error(argc >= 2 ? argv[1] : NULL, argc >= 2 ? "play option" : NULL);
+    }
+    return ret;
+}
+
+/**
+ * @brief command struct: a command that takes its own arguments (typically a long-running one)
+ */
+struct command
+{
+    const char* name;
+    int (*run)(int argc, char** argv);
+};
+
+/**
+ * @brief table of all commands that take their own arguments
+ */
+static const struct command commands[] =
+{
+    { "compile",  run_compile  },
+    { "effect",   run_effect   },
+    { "flush",    run_flush    },
+    { "keys",     run_keys     },
+    { "play",     run_play     },
+    { "plugin",   run_plugin   },
+    { "publish",  run_publish  },
+    { "schedule", run_schedule },
+    { "watch",    run_watch    }
+};
+
+/**
+ * @brief searches the command table
+ * @param name the command's name
+ * @returns the respective command or null if there is no such command
+ */
+const struct command* find_command(const char* name)
+{
+    const struct command* ret = NULL;
+    for (size_t i=0; i<sizeof(commands)/sizeof(commands[0]) && ret == NULL; ++i)
+        if (strcmp(name, commands[i].name) == 0)
+            ret = &commands[i];
+    return ret;
+}
+
+/**
+ * @brief application's entry point
+ * @param argc number of command line arguments
+ * @param argv command line argument array; the first value is always the program's name
+ * @return 0 if everything succeeded, -1 otherwise
+ */
+int main(int argc, char** argv)
+{
+    //the color values (at most 7); num_regions tracks the actual number of parsed colors (i.e. regions to set) while with_rgb indicates if there is any rgb-color used
+    struct color colors[7];
+    int num_regions = 0;
+    bool with_rgb = false;
+    int ret = argc > 1 ? hid_init() : -1;
+
+    //commands with their own arguments (effects, plugins, etc.) are dispatched before any color parsing
+    const struct command* command = ret == 0 ? find_command(argv[1]) : NULL;
+    if (command != NULL)
+    {
+        ret = command->run(argc-2, &argv[2]);
+        if (hid_exit() != 0)
+            ret = -1;
+        return ret;
     }
 
+    //the optional fade duration might be given at any position; it is removed such that the remaining arguments keep their usual structure
+    int fade_ms = 0;
+    if (ret == 0 && (argc = extract_fade_option(argc, argv, &fade_ms)) < 0)
+    {
+        hid_exit();
+        return -1;
+    }
+
+    //if colors are supplied, they are always the first argument, so try to parse them
+    if (ret == 0 && argc > 1 && (ret = parse_color_list(argv[1], colors, 7, &num_regions)) == 0)
+        for (int i=0; i<num_regions; ++i)
+            if (colors[i].profile == custom)
+                with_rgb = true;
+
     //the brightness and the mode; initialize them according to the parsed command line arguments
     enum brightness br = ret == 0 ? rgb : -1;
     enum mode md = ret == 0 ? normal : -1;
@@ -344,8 +1165,9 @@ int main(int argc, char** argv)
             break;
 
         default:
-            // too many or no command line arguments
+            // too many or no command line arguments (e.g. only the fade option)
             on_parse_error(NULL, NULL);
+            ret = -1;
             break;
     }
 
@@ -361,14 +1183,45 @@ int main(int argc, char** argv)
                 num_regions = 3;
             }
 
-            for (int i=0; i<num_regions && ret == 0; ++i)
-                if (set_color(dev, colors[i], i+1, br) <= 0)
+            //a fade starts at the last applied state, which is only possible for full rgb selections of known regions
+            struct color previous[FADE_MAX_REGIONS];
+            int num_previous = 0;
+            if (fade_ms > 0 && br == rgb && num_regions > 0 &&
+                load_applied_colors(dev, previous, &num_previous) == 0 && num_previous >= num_regions)
+            {
+                struct fade_stats stats;
+                if (fade(dev, previous, colors, num_regions, fade_ms, &stats) == 0)
+                    printf("fade: %d steps, %d reports, avg. latency %.2f ms, ended %.1f ms late\n",
+                           stats.steps, stats.reports, stats.latency * 1000, stats.lateness * 1000);
+                else
                     ret = -1;
+            }
+            else
+            {
+                for (int i=0; i<num_regions && ret == 0; ++i)
+                    if (set_color(dev, colors[i], i+1, br) < 0) //0 if the keyboard does not have the region
+                        ret = -1;
+            }
 
             if (ret == 0 && set_mode(dev, md) <= 0)
                 ret = -1;
 
-            hid_close(dev);
+            //remember the applied colors as the starting point of the next fade (failing to do so is not an error); the simulated keyboard keeps its own state
+            if (ret == 0 && num_regions > 0 && !sim_is_device(dev))
+            {
+                if (br != rgb) //an explicit brightness dims the predefined colors in thirds (off turns them off)
+                {
+                    for (int i=0; i<num_regions; ++i)
+                    {
+                        colors[i].red = (byte)(colors[i].red * (3 - br) / 3);
+                        colors[i].green = (byte)(colors[i].green * (3 - br) / 3);
+                        colors[i].blue = (byte)(colors[i].blue * (3 - br) / 3);
+                    }
+                }
+                fade_save_state(FADE_STATE_PATH, colors, num_regions);
+            }
+
+            close_keyboard(dev);
         }
         else
         {
@@ -5,10 +5,26 @@
  */
 
 #include "msiklm.h"
+#include "protocol.h"
+#include "sim.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define MAX_OPEN_KEYBOARDS 8
+
+/**
+ * @brief keyboard handle struct: the protocol of a keyboard that was opened by open_keyboard()
+ */
+struct keyboard_handle
+{
+    hid_device* dev;
+    const struct protocol* protocol;
+};
+
+//all opened hid keyboards (the region protocol is used for all other devices, including the simulated keyboard)
+static struct keyboard_handle open_keyboards[MAX_OPEN_KEYBOARDS];
+
 int parse_color(const char* color_str, struct color* result)
 {
     int ret = -1;
@@ -236,6 +252,38 @@ int parse_color(const char* color_str, struct color* result)
     return ret;
 }
 
+int parse_color_list(const char* colors_str, struct color* colors, int max_colors, int* num_colors)
+{
+    int ret = -1;
+    *num_colors = 0;
+    size_t length = strlen(colors_str);
+    char* color_arg = (char*)malloc((length+1) * sizeof(char));
+    if (color_arg != NULL)
+    {
+        strcpy(color_arg, colors_str);
+        color_arg[length] = '\0';
+
+        char* saved_ptr = NULL;
+        const char* color_str = strtok_r(color_arg, ",", &saved_ptr);
+        ret = 0;
+        while (color_str != NULL && ret == 0) //parse into next color slot as long as a color is available for parsing (color_str != NULL) and previous parsing succeeded (ret == 0)
+        {
+            if (*num_colors < max_colors &&
+                !(ret = parse_color(color_str, &(colors[*num_colors]))))
+            {
+                ++(*num_colors);
+                color_str = strtok_r(NULL, ",", &saved_ptr);
+            }
+            else
+            {
+                ret = -1;
+            }
+        }
+        free(color_arg);
+    }
+    return ret;
+}
+
 enum brightness parse_brightness(const char* brightness_str)
 {
     enum brightness ret = -1;
@@ -313,46 +361,113 @@ bool keyboard_found()
     hid_device* dev = open_keyboard();
     bool ret = dev != NULL;
     if (ret)
-        hid_close(dev);
+        close_keyboard(dev);
     return ret;
 }
 
 hid_device* open_keyboard()
 {
     hid_device* dev = NULL;
-    if (hid_init() == 0)
-        dev = hid_open(0x1770, 0xff00, 0);
+    if (sim_enabled()) //the simulated keyboard replaces the hardware at runtime and speaks the region protocol
+    {
+        dev = sim_open();
+    }
+    else if (hid_init() == 0)
+    {
+        bool unverified = getenv(PROTOCOL_UNVERIFIED_ENV) != NULL;
+        const struct protocol* protocol = NULL;
+        for (const struct device* device = device_table; device->protocol != NULL && dev == NULL; ++device)
+        {
+            if (device->verified || unverified)
+            {
+                dev = hid_open(device->vendor_id, device->product_id, 0);
+                protocol = device->protocol;
+            }
+        }
+
+        //remember the protocol of the handle; a keyboard whose protocol cannot be remembered is not usable
+        if (dev != NULL)
+        {
+            struct keyboard_handle* handle = NULL;
+            for (int i=0; i<MAX_OPEN_KEYBOARDS && handle == NULL; ++i)
+                if (open_keyboards[i].dev == NULL)
+                    handle = &open_keyboards[i];
+
+            if (handle != NULL)
+            {
+                handle->dev = dev;
+                handle->protocol = protocol;
+            }
+            else
+            {
+                hid_close(dev);
+                dev = NULL;
+            }
+        }
+    }
     return dev;
 }
 
+void close_keyboard(hid_device* dev)
+{
+    if (!sim_is_device(dev))
+    {
+        for (int i=0; i<MAX_OPEN_KEYBOARDS; ++i)
+            if (open_keyboards[i].dev == dev)
+                open_keyboards[i].dev = NULL;
+        hid_close(dev);
+    }
+}
+
+const struct protocol* keyboard_protocol(const hid_device* dev)
+{
+    const struct protocol* ret = &region_protocol;
+    for (int i=0; i<MAX_OPEN_KEYBOARDS; ++i)
+        if (dev != NULL && open_keyboards[i].dev == dev)
+            ret = open_keyboards[i].protocol;
+    return ret;
+}
+
+int send_report(hid_device* dev, const byte* report, size_t length)
+{
+    return sim_is_device(dev) ? sim_send_report(report, length) : hid_send_feature_report(dev, report, length);
+}
+
 int set_color(hid_device* dev, struct color color, enum region region, enum brightness brightness)
 {
     int ret = -1;
     if ((region == left || region == middle || region == right || region == logo || region == front_left || region == front_right || region == mouse) && //valid region
         (brightness == rgb || brightness == off || color.profile != custom)) //explicit brightness is only valid for predefined colors (i.e. rgb-selection mixed with brightness makes little sense)
     {
-        byte buffer[8];
-        buffer[0] = 1;
-        buffer[1] = 2;
-        buffer[3] = (byte)region;
-        buffer[7] = 236; //EOR (end of request)
+        byte buffer[PROTOCOL_MAX_REPORT_SIZE];
+        int length = keyboard_protocol(dev)->encode_color(buffer, color, region, brightness);
+        if (length > 0)
+            ret = send_report(dev, buffer, length);
+        else if (length == 0) //the keyboard does not have this region
+            ret = 0;
+    }
+    return ret;
+}
 
-        if (brightness == rgb) //full rgb selection -> rgb-command
-        {
-            buffer[2] = 64; //rgb
-            buffer[4] = color.red;
-            buffer[5] = color.green;
-            buffer[6] = color.blue;
-        }
-        else //predefined color with explicit brightness -> set-command
+int set_keys(hid_device* dev, const struct key_color* keys, int num_keys)
+{
+    int ret = -1;
+    const struct protocol* protocol = keyboard_protocol(dev);
+    int max_keys = protocol->max_keys_per_report;
+    if (max_keys > 0 && num_keys >= 0)
+    {
+        //a full keyboard update only takes a few transfers as each report carries up to max_keys keys
+        byte buffer[PROTOCOL_MAX_REPORT_SIZE];
+        ret = 0;
+        for (int first=0; first<num_keys && ret >= 0; first += max_keys)
         {
-            buffer[2] = 66; //set
-            buffer[4] = brightness != off ? (byte)color.profile : 0;
-            buffer[5] = (byte)brightness;
-            buffer[6] = 0;
+            int count = num_keys - first < max_keys ? num_keys - first : max_keys;
+            int length = protocol->encode_keys(buffer, &keys[first], count);
+            if (length > 0 && send_report(dev, buffer, length) > 0)
+                ++ret;
+            else
+                ret = -1;
         }
-
-        ret = hid_send_feature_report(dev, buffer, 8);
     }
     return ret;
 }
@@ -362,16 +477,10 @@ int set_mode(hid_device* dev, enum mode mode)
     int ret = -1;
     if (mode == normal || mode == gaming || mode == breathe || mode == demo || mode == wave) //check for a valid mode
     {
-        byte buffer[8];
-        buffer[0] = 1;
-        buffer[1] = 2;
-        buffer[2] = 65; //commit
-        buffer[3] = (byte)mode; //set hardware mode
-        buffer[4] = 0;
-        buffer[5] = 0;
-        buffer[6] = 0;
-        buffer[7] = 236; //EOR (end of request)
-        ret = hid_send_feature_report(dev, buffer, 8);
+        byte buffer[PROTOCOL_MAX_REPORT_SIZE];
+        int length = keyboard_protocol(dev)->encode_mode(buffer, mode);
+        if (length > 0)
+            ret = send_report(dev, buffer, length);
     }
     return ret;
 }
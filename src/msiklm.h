@@ -16,6 +16,8 @@
 
 typedef unsigned char byte;
 
+struct protocol;
+
 /**
  * @brief color profile enum: the color profile either defines a default color or indicates a custom selection
  */
@@ -58,6 +60,17 @@ enum region
     mouse       = 7
 };
 
+/**
+ * @brief key color struct: the color of a single key of a per-key keyboard
+ */
+struct key_color
+{
+    byte key; //HID usage ID of the key
+    byte red;
+    byte green;
+    byte blue;
+};
+
 /**
  * @brief brightness enum: the brightness is either defined by the rgb selection or one of four predefined values
  */
@@ -91,6 +104,16 @@ enum mode
  */
 int parse_color(const char* color_str, struct color* result);
 
+/**
+ * @brief parses a comma-separated list of colors (without spaces), e.g. red,green,[0;0;255]
+ * @param colors_str the color list as a string
+ * @param colors the parsed colors
+ * @param max_colors the maximal number of colors
+ * @param num_colors the actual number of parsed colors
+ * @returns 0 if parsing succeeded, -1 on error
+ */
+int parse_color_list(const char* colors_str, struct color* colors, int max_colors, int* num_colors);
+
 /**
  * @brief parses a string into a brightness value
  * @param brightness_str the brightness value as a string
@@ -112,21 +135,54 @@ enum mode parse_mode(const char* mode_str);
 bool keyboard_found();
 
 /**
- * @brief tries to open the MSI gaming notebook's SteelSeries keyboard
+ * @brief tries to open the MSI gaming notebook's SteelSeries keyboard; all keyboards of the device table (cf. protocol.c) are tried
+ *        unless the simulated keyboard is selected by the environment variable MSIKLM_SIM (cf. sim.h); unverified keyboards are
+ *        only tried if the environment variable MSIKLM_UNVERIFIED is set
  * @returns a corresponding hid_device, null if the keyboard was not detected
  */
 hid_device* open_keyboard();
 
+/**
+ * @brief closes a keyboard that was opened by open_keyboard()
+ * @param dev the hid device
+ */
+void close_keyboard(hid_device* dev);
+
+/**
+ * @brief returns the protocol of a keyboard (cf. protocol.h)
+ * @param dev the hid device
+ * @returns the keyboard's protocol, the MSI region protocol if the device was not opened by open_keyboard() (e.g. the simulated keyboard)
+ */
+const struct protocol* keyboard_protocol(const hid_device* dev);
+
+/**
+ * @brief sends a single, already encoded feature report to the keyboard
+ * @param dev the hid device
+ * @param report the report
+ * @param length the report's length in bytes
+ * @returns the actual number of bytes written, -1 on error
+ */
+int send_report(hid_device* dev, const byte* report, size_t length);
+
 /**
  * @brief sets the selected color for a specified region (the colors will only be set as soon as set_mode() is called in advance)
  * @param dev the hid device
  * @param color the color value
  * @param region the region where the color should be set
  * @param brightness the selected brightness (note that it also defines the kind of command that is send to the keyboard)
- * @returns the actual number of bytes written, -1 on error
+ * @returns the actual number of bytes written, 0 if the keyboard does not have the region (nothing is sent), -1 on error
  */
 int set_color(hid_device* dev, struct color color, enum region region, enum brightness brightness);
 
+/**
+ * @brief sets the colors of individual keys of a per-key keyboard; as many keys as possible are packed into each report
+ * @param dev the hid device
+ * @param keys the keys and their colors
+ * @param num_keys the number of keys
+ * @returns the number of sent reports, -1 on error (or if the keyboard does not support per-key colors)
+ */
+int set_keys(hid_device* dev, const struct key_color* keys, int num_keys);
+
 /**
  * @brief sets the selected mode
  * @param dev the hid device
@@ -0,0 +1,116 @@
+/**
+ * @file plugin.c
+ *
+ * @brief source file that contains the loader for effect plugins and the enforcement of their render-time budget
+ */
+
+#include "plugin.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief returns the current monotonic time in nanoseconds
+ */
+static long long monotonic_nanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int plugin_load(struct plugin* plugin, const char* path, int num_regions, long budget_ns)
+{
+    int ret = -1;
+    memset(plugin, 0, sizeof(struct plugin));
+    plugin->path = path;
+    plugin->budget_ns = budget_ns;
+
+    //dlopen() searches the library path for a name without a slash, so a plugin in the working directory needs an explicit ./
+    char file[4096];
+    snprintf(file, sizeof(file), strchr(path, '/') == NULL ? "./%s" : "%s", path);
+
+    plugin->handle = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+    if (plugin->handle != NULL)
+    {
+        const int* abi = (const int*)dlsym(plugin->handle, "msiklm_plugin_abi");
+        *(void**)(&plugin->init) = dlsym(plugin->handle, "msiklm_plugin_init");
+        *(void**)(&plugin->render) = dlsym(plugin->handle, "msiklm_plugin_render");
+        *(void**)(&plugin->destroy) = dlsym(plugin->handle, "msiklm_plugin_destroy");
+
+        if (abi != NULL && *abi == MSIKLM_PLUGIN_ABI && plugin->init != NULL && plugin->render != NULL && plugin->destroy != NULL)
+        {
+            if (plugin->init(num_regions, &plugin->state) == 0)
+                ret = 0;
+            else
+                printf("plugin %s: initialization failed\n", path);
+        }
+        else
+        {
+            printf("plugin %s: missing symbols or incompatible ABI (expected version %d)\n", path, MSIKLM_PLUGIN_ABI);
+        }
+
+        if (ret != 0)
+        {
+            dlclose(plugin->handle);
+            plugin->handle = NULL;
+        }
+    }
+    else
+    {
+        printf("plugin %s: %s\n", path, dlerror());
+    }
+    return ret;
+}
+
+int plugin_render(void* context, struct color* frame, int num_regions, double t, double dt)
+{
+    int ret = 0;
+    struct plugin* plugin = (struct plugin*)context;
+
+    long long start = monotonic_nanoseconds();
+    plugin->render(plugin->state, frame, num_regions, t, dt);
+    long elapsed = (long)(monotonic_nanoseconds() - start);
+
+    ++plugin->frames;
+    plugin->total_ns += elapsed;
+    if (elapsed > plugin->worst_ns)
+        plugin->worst_ns = elapsed;
+
+    if (plugin->budget_ns > 0 && elapsed > plugin->budget_ns)
+    {
+        if (plugin->overruns++ == 0)
+            printf("plugin %s: frame took %ld us, budget is %ld us\n", plugin->path, elapsed / 1000, plugin->budget_ns / 1000);
+
+        if (++plugin->consecutive >= PLUGIN_MAX_OVERRUNS)
+        {
+            printf("plugin %s: stopped after exceeding its budget %d frames in a row\n", plugin->path, PLUGIN_MAX_OVERRUNS);
+            ret = -1;
+        }
+    }
+    else
+    {
+        plugin->consecutive = 0;
+    }
+
+    //the profile is part of the host's state, so make sure a plugin cannot turn a region into a non-rgb color
+    for (int i=0; i<num_regions; ++i)
+        frame[i].profile = custom;
+    return ret;
+}
+
+void plugin_unload(struct plugin* plugin)
+{
+    if (plugin->handle != NULL)
+    {
+        plugin->destroy(plugin->state);
+        dlclose(plugin->handle);
+        plugin->handle = NULL;
+
+        if (plugin->overruns > 0)
+            printf("plugin %s: slow, %lu of %lu frames exceeded the budget (average %lld us, worst %ld us)\n",
+                   plugin->path, plugin->overruns, plugin->frames,
+                   plugin->total_ns / (long long)plugin->frames / 1000, plugin->worst_ns / 1000);
+    }
+}
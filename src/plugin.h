@@ -0,0 +1,77 @@
+/**
+ * @file plugin.h
+ *
+ * @brief header file for loadable effect plugins and their frame-callback ABI
+ *
+ * A plugin is a shared library that exports the following symbols:
+ *
+ *     const int msiklm_plugin_abi = MSIKLM_PLUGIN_ABI;
+ *     int  msiklm_plugin_init(int num_regions, void** state);
+ *     void msiklm_plugin_render(void* state, struct color* frame, int num_regions, double t, double dt);
+ *     void msiklm_plugin_destroy(void* state);
+ *
+ * msiklm_plugin_init() is called once and might allocate the plugin's state (it returns 0 on success),
+ * msiklm_plugin_render() renders a frame in place into the host's preallocated frame array and must
+ * neither allocate nor block, msiklm_plugin_destroy() finally releases the state.
+ */
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include "msiklm.h"
+
+#define MSIKLM_PLUGIN_ABI 1
+
+#define PLUGIN_MAX_OVERRUNS 30 //number of consecutive frames a plugin might exceed its budget before it is stopped
+
+typedef int  (*plugin_init_function)(int num_regions, void** state);
+typedef void (*plugin_render_function)(void* state, struct color* frame, int num_regions, double t, double dt);
+typedef void (*plugin_destroy_function)(void* state);
+
+/**
+ * @brief plugin struct: a loaded plugin including its render-time statistics
+ */
+struct plugin
+{
+    const char* path;
+    void* handle;
+    void* state;
+    plugin_init_function init;
+    plugin_render_function render;
+    plugin_destroy_function destroy;
+    long budget_ns;                //render-time budget per frame in nanoseconds, 0 disables the budget
+    unsigned long frames;          //number of rendered frames
+    unsigned long overruns;        //number of frames that exceeded the budget
+    unsigned long consecutive;     //number of consecutive frames that exceeded the budget
+    long worst_ns;                 //worst render time in nanoseconds
+    long long total_ns;            //accumulated render time in nanoseconds
+};
+
+/**
+ * @brief loads a plugin, checks its ABI version and initializes it
+ * @param plugin the plugin to load
+ * @param path the path of the shared library
+ * @param num_regions the number of regions the plugin will render
+ * @param budget_ns the render-time budget per frame in nanoseconds, 0 disables the budget
+ * @returns 0 on success, -1 on error
+ */
+int plugin_load(struct plugin* plugin, const char* path, int num_regions, long budget_ns);
+
+/**
+ * @brief renders a frame with the plugin and enforces its render-time budget (compatible with render_callback of animation.h)
+ * @param context the plugin
+ * @param frame the preallocated frame array
+ * @param num_regions the number of regions in the frame
+ * @param t the time in seconds since the animation started
+ * @param dt the time in seconds since the previous frame
+ * @returns 0 on success, -1 if the plugin exceeded its budget PLUGIN_MAX_OVERRUNS times in a row
+ */
+int plugin_render(void* context, struct color* frame, int num_regions, double t, double dt);
+
+/**
+ * @brief destroys and unloads a plugin and reports its render-time statistics if it was slow
+ * @param plugin the plugin to unload
+ */
+void plugin_unload(struct plugin* plugin);
+
+#endif //PLUGIN_H
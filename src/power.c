@@ -0,0 +1,306 @@
+/**
+ * @file power.c
+ *
+ * @brief source file that contains the power policy that limits the keyboard's USB traffic of long-running lighting loops
+ */
+
+#include "power.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define POWER_SUPPLY_INTERVAL 5  //seconds between two checks of the power supply
+#define POWER_STATS_INTERVAL  60 //seconds between two statistics outputs
+
+/**
+ * @brief returns the current monotonic time in seconds
+ */
+static time_t monotonic_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * @brief returns the current monotonic time in milliseconds
+ */
+static long long monotonic_milliseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief reads a single line attribute of a power supply (e.g. /sys/class/power_supply/AC/online) and strips the trailing newline
+ * @returns 0 on success, -1 on error
+ */
+static int read_attribute(const char* root, const char* supply, const char* attribute, char* buffer, size_t size)
+{
+    int ret = -1;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, supply, attribute);
+
+    FILE* file = fopen(path, "r");
+    if (file != NULL)
+    {
+        if (fgets(buffer, size, file) != NULL)
+        {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            ret = 0;
+        }
+        fclose(file);
+    }
+    return ret;
+}
+
+/**
+ * @brief closes an input device that hung up (e.g. because it was unplugged) and removes it from the monitor
+ */
+static void drop_input(struct power_monitor* monitor, int index)
+{
+    close(monitor->input_fds[index]);
+    monitor->input_fds[index] = monitor->input_fds[--monitor->num_inputs];
+
+    //without any readable input device, user activity cannot be detected -> never go idle
+    if (monitor->num_inputs == 0)
+        monitor->policy.idle_timeout = 0;
+}
+
+/**
+ * @brief reads all pending events of all input devices; devices that cannot be read anymore are dropped
+ * @returns true if there was any input activity
+ */
+static bool drain_inputs(struct power_monitor* monitor)
+{
+    bool activity = false;
+    char buffer[512];
+    for (int i=monitor->num_inputs - 1; i>=0; --i)
+    {
+        ssize_t length;
+        while ((length = read(monitor->input_fds[i], buffer, sizeof(buffer))) > 0)
+            activity = true;
+        if (length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            drop_input(monitor, i);
+    }
+    return activity;
+}
+
+void power_policy_init(struct power_policy* policy)
+{
+    policy->fps_ac = 30;
+    policy->fps_battery = 0;
+    policy->battery_mode = breathe;
+    policy->idle_timeout = 300;
+    policy->supply_root = POWER_SUPPLY_ROOT;
+    policy->input_root = POWER_INPUT_ROOT;
+}
+
+int power_on_battery(const char* supply_root)
+{
+    int ret = -1;
+    DIR* dir = opendir(supply_root);
+    if (dir != NULL)
+    {
+        bool found_mains = false;
+        bool mains_online = false;
+        bool discharging = false;
+        char value[64];
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.' || read_attribute(supply_root, entry->d_name, "type", value, sizeof(value)) != 0)
+                continue;
+
+            if (strcmp(value, "Mains") == 0)
+            {
+                found_mains = true;
+                if (read_attribute(supply_root, entry->d_name, "online", value, sizeof(value)) == 0 && strcmp(value, "1") == 0)
+                    mains_online = true;
+            }
+            else if (strcmp(value, "Battery") == 0)
+            {
+                if (read_attribute(supply_root, entry->d_name, "status", value, sizeof(value)) == 0 && strcmp(value, "Discharging") == 0)
+                    discharging = true;
+            }
+        }
+        closedir(dir);
+
+        //an offline mains adapter is the most reliable indicator, otherwise fall back to the battery status (no supply at all -> desktop on AC)
+        ret = found_mains ? !mains_online : discharging;
+    }
+    return ret;
+}
+
+int power_monitor_open(struct power_monitor* monitor, const struct power_policy* policy)
+{
+    int ret = -1;
+    if (monitor != NULL && policy != NULL)
+    {
+        monitor->policy = *policy;
+        monitor->num_inputs = 0;
+
+        if (policy->idle_timeout > 0)
+        {
+            DIR* dir = opendir(policy->input_root);
+            if (dir != NULL)
+            {
+                struct dirent* entry;
+                while ((entry = readdir(dir)) != NULL && monitor->num_inputs < POWER_MAX_INPUTS)
+                {
+                    if (strncmp(entry->d_name, "event", 5) == 0)
+                    {
+                        char path[512];
+                        snprintf(path, sizeof(path), "%s/%s", policy->input_root, entry->d_name);
+                        //fifos (as used by fake input trees) are opened for writing as well such that they do not hang up without a writer
+                        int fd = open(path, (entry->d_type == DT_FIFO ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+                        if (fd >= 0)
+                            monitor->input_fds[monitor->num_inputs++] = fd;
+                    }
+                }
+                closedir(dir);
+            }
+        }
+
+        //without any readable input device, user activity cannot be detected -> never go idle
+        if (monitor->num_inputs == 0)
+            monitor->policy.idle_timeout = 0;
+
+        monitor->on_battery = power_on_battery(policy->supply_root) == 1;
+        monitor->last_activity = monitor->last_supply_check = monitor->stats_start = monotonic_seconds();
+        monitor->reports = 0;
+        monitor->wakeups = 0;
+        ret = 0;
+    }
+    return ret;
+}
+
+void power_monitor_close(struct power_monitor* monitor)
+{
+    for (int i=0; i<monitor->num_inputs; ++i)
+        close(monitor->input_fds[i]);
+    monitor->num_inputs = 0;
+}
+
+enum power_state power_update(struct power_monitor* monitor)
+{
+    time_t now = monotonic_seconds();
+
+    if (drain_inputs(monitor))
+        monitor->last_activity = now;
+
+    if (now - monitor->last_supply_check >= POWER_SUPPLY_INTERVAL)
+    {
+        monitor->on_battery = power_on_battery(monitor->policy.supply_root) == 1;
+        monitor->last_supply_check = now;
+    }
+
+    time_t elapsed = now - monitor->stats_start;
+    if (elapsed >= POWER_STATS_INTERVAL)
+    {
+        printf("power: %lu reports/min, %lu wakeups/min (%s)\n",
+               monitor->reports * 60 / elapsed,
+               monitor->wakeups * 60 / elapsed,
+               monitor->on_battery ? "battery" : "AC");
+        monitor->reports = 0;
+        monitor->wakeups = 0;
+        monitor->stats_start = now;
+    }
+
+    enum power_state ret = power_active;
+    if (monitor->policy.idle_timeout > 0 && now - monitor->last_activity >= monitor->policy.idle_timeout)
+        ret = power_idle;
+    else if (monitor->on_battery)
+        ret = power_battery;
+    return ret;
+}
+
+long power_frame_interval(const struct power_monitor* monitor, enum power_state state)
+{
+    long ret = 0;
+    if (state == power_active && monitor->policy.fps_ac > 0)
+        ret = 1000000000L / monitor->policy.fps_ac;
+    else if (state == power_battery && monitor->policy.fps_battery > 0)
+        ret = 1000000000L / monitor->policy.fps_battery;
+    return ret;
+}
+
+int power_wait_activity(struct power_monitor* monitor, int timeout_ms)
+{
+    int ret = 0;
+    struct pollfd fds[POWER_MAX_INPUTS];
+    int num_fds = monitor->num_inputs;
+    for (int i=0; i<num_fds; ++i)
+    {
+        fds[i].fd = monitor->input_fds[i];
+        fds[i].events = POLLIN;
+    }
+
+    int ready = num_fds > 0 ? poll(fds, num_fds, timeout_ms) : 0;
+    if (ready < 0 && errno == EINTR)
+    {
+        ret = -1;
+    }
+    else if (ready > 0)
+    {
+        //devices that hung up would wake up every poll immediately (descending, as dropping moves the last device to the index)
+        for (int i=num_fds - 1; i>=0; --i)
+            if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+                drop_input(monitor, i);
+        if (drain_inputs(monitor))
+            ret = 1;
+    }
+
+    if (monitor->num_inputs == 0)
+        ret = 1;
+    if (ret > 0)
+        monitor->last_activity = monotonic_seconds();
+    power_account_wakeup(monitor);
+    return ret;
+}
+
+int power_sleep(struct power_monitor* monitor, hid_device** dev, int timeout_ms)
+{
+    //release the keyboard such that the kernel is able to autosuspend it
+    if (*dev != NULL)
+        close_keyboard(*dev);
+    *dev = NULL;
+
+    //the timeout is an absolute deadline, wakeups without activity (e.g. a dropped input device) do not extend it
+    long long end = monotonic_milliseconds() + timeout_ms;
+    int woken = 0;
+    bool expired = false;
+    while (woken == 0 && !expired)
+    {
+        long long remaining = timeout_ms >= 0 ? end - monotonic_milliseconds() : -1;
+        if (timeout_ms >= 0 && remaining <= 0)
+            expired = true;
+        else
+            woken = power_wait_activity(monitor, (int)remaining);
+    }
+
+    int ret = 1;
+    if (woken > 0)
+    {
+        *dev = open_keyboard();
+        ret = *dev != NULL ? 0 : -1;
+    }
+    return ret;
+}
+
+void power_account_reports(struct power_monitor* monitor, int count)
+{
+    if (count > 0)
+        monitor->reports += count;
+}
+
+void power_account_wakeup(struct power_monitor* monitor)
+{
+    ++monitor->wakeups;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file power.h
+ *
+ * @brief header file for the power policy that limits the keyboard's USB traffic of long-running lighting loops
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include <time.h>
+#include "msiklm.h"
+
+#define POWER_SUPPLY_ROOT "/sys/class/power_supply"
+#define POWER_INPUT_ROOT  "/dev/input"
+#define POWER_MAX_INPUTS  32
+
+/**
+ * @brief power state enum: the state a lighting loop should currently run in
+ */
+enum power_state
+{
+    power_active  = 0, //on AC power and user active -> full frame rate
+    power_battery = 1, //on battery -> reduced frame rate or firmware fallback mode
+    power_idle    = 2  //no user activity -> no USB traffic at all, the device is released
+};
+
+/**
+ * @brief power policy struct: configures how a lighting loop reacts to the power supply and user activity
+ */
+struct power_policy
+{
+    int fps_ac;                    //frame rate while on AC power
+    int fps_battery;               //frame rate while on battery, 0 selects the firmware fallback mode instead
+    enum mode battery_mode;        //firmware mode (e.g. breathe or wave) used on battery if fps_battery is 0
+    int idle_timeout;              //seconds without input activity until the device is released, 0 disables idling
+    const char* supply_root;       //power supply directory, normally POWER_SUPPLY_ROOT (can point to a fake sysfs tree)
+    const char* input_root;        //input device directory, normally POWER_INPUT_ROOT (can point to a directory of fifos)
+};
+
+/**
+ * @brief power monitor struct: tracks power supply, user activity and traffic statistics of a lighting loop
+ */
+struct power_monitor
+{
+    struct power_policy policy;
+    int input_fds[POWER_MAX_INPUTS];
+    int num_inputs;
+    bool on_battery;
+    time_t last_activity;          //monotonic time of the last input event
+    time_t last_supply_check;      //monotonic time of the last power supply check
+    time_t stats_start;            //monotonic time since when the statistics are counted
+    unsigned long reports;         //feature reports sent since stats_start
+    unsigned long wakeups;         //wakeups of the lighting loop since stats_start
+};
+
+/**
+ * @brief initializes a power policy with its default values (30 fps on AC, breathe mode on battery, idle after 5 minutes)
+ * @param policy the policy to initialize
+ */
+void power_policy_init(struct power_policy* policy);
+
+/**
+ * @brief checks whether the system is running on battery by inspecting the power supplies in the given directory
+ * @param supply_root the power supply directory (normally POWER_SUPPLY_ROOT)
+ * @returns 1 if running on battery, 0 if running on AC power (or if there is no battery at all), -1 on error
+ */
+int power_on_battery(const char* supply_root);
+
+/**
+ * @brief opens a power monitor, i.e. determines the power supply and opens all input devices to watch for user activity
+ * @param monitor the monitor to open
+ * @param policy the policy to apply (it is copied)
+ * @returns 0 on success, -1 on error
+ */
+int power_monitor_open(struct power_monitor* monitor, const struct power_policy* policy);
+
+/**
+ * @brief closes a power monitor and all of its input devices
+ * @param monitor the monitor to close
+ */
+void power_monitor_close(struct power_monitor* monitor);
+
+/**
+ * @brief updates the monitor without blocking (drains pending input events, re-checks the power supply from time to time and logs the statistics once per minute)
+ * @param monitor the monitor
+ * @returns the power state the lighting loop should run in
+ */
+enum power_state power_update(struct power_monitor* monitor);
+
+/**
+ * @brief returns the frame interval that should be used in the current power state
+ * @param monitor the monitor
+ * @param state the current power state as returned by power_update()
+ * @returns the frame interval in nanoseconds, 0 if no frames should be rendered at all (idle or firmware fallback)
+ */
+long power_frame_interval(const struct power_monitor* monitor, enum power_state state);
+
+/**
+ * @brief blocks until there is input activity, the timeout expires or a signal is received; no USB traffic is caused while waiting
+ *
+ * Input devices that hang up (e.g. unplugged ones) are dropped; if no input device is left, idling is disabled.
+ * @param monitor the monitor
+ * @param timeout_ms the timeout in milliseconds, -1 to wait infinitely
+ * @returns 1 if there was input activity (or no input device is left), 0 on timeout, -1 if the wait was interrupted by a signal
+ */
+int power_wait_activity(struct power_monitor* monitor, int timeout_ms);
+
+/**
+ * @brief releases the keyboard while the user is idle and reopens it immediately as soon as there is any input activity again
+ * @param monitor the monitor
+ * @param dev the hid device; it is closed while idle and replaced by the reopened one (null if reopening failed or the sleep was interrupted or timed out)
+ * @param timeout_ms the maximum time to sleep in milliseconds, -1 to sleep until there is input activity
+ * @returns 0 on success, 1 if the sleep was interrupted by a signal or timed out (the caller should check if it has to stop), -1 if the keyboard could not be reopened
+ */
+int power_sleep(struct power_monitor* monitor, hid_device** dev, int timeout_ms);
+
+/**
+ * @brief accounts sent feature reports for the statistics
+ * @param monitor the monitor
+ * @param count the number of sent reports
+ */
+void power_account_reports(struct power_monitor* monitor, int count);
+
+/**
+ * @brief accounts a wakeup of the lighting loop for the statistics
+ * @param monitor the monitor
+ */
+void power_account_wakeup(struct power_monitor* monitor);
+
+#endif //POWER_H
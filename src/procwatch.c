@@ -0,0 +1,433 @@
+/**
+ * @file procwatch.c
+ *
+ * @brief source file that contains the per-application profile switching
+ */
+
+#include "procwatch.h"
+#include "animation.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+
+#define PROCWATCH_DEFAULT_NAME "default"
+
+/**
+ * @brief hashes an executable name (32-bit FNV-1a)
+ */
+static uint32_t hash_name(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c != '\0'; ++c)
+    {
+        hash ^= (byte)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief returns the nanoseconds elapsed since the given point in time (monotonic clock)
+ */
+static long long nanoseconds_since(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)(now.tv_sec - start->tv_sec) * 1000000000LL + (now.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief determines the executable name of a process: the file name of /proc/<pid>/exe or, if it is not accessible, /proc/<pid>/comm
+ * @returns 0 on success, -1 if the process does not exist (anymore)
+ */
+static int read_executable(pid_t pid, char* name, size_t size)
+{
+    int ret = -1;
+    char path[64];
+    char target[512];
+    snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+    ssize_t length = readlink(path, target, sizeof(target) - 1);
+    if (length > 0)
+    {
+        target[length] = '\0';
+        const char* base = strrchr(target, '/');
+        base = base != NULL ? base + 1 : target;
+        if (strlen(base) < size) //longer names cannot have a profile anyway
+        {
+            strcpy(name, base);
+            ret = 0;
+        }
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+        FILE* file = fopen(path, "r");
+        if (file != NULL)
+        {
+            if (fgets(name, (int)size, file) != NULL)
+            {
+                name[strcspn(name, "\n")] = '\0';
+                ret = 0;
+            }
+            fclose(file);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief inserts a profile into the hash table
+ * @returns 0 on success, -1 if there already is a profile for the executable
+ */
+static int insert_profile(struct procwatch* watch, int index)
+{
+    int ret = 0;
+    uint32_t slot = hash_name(watch->profiles[index].executable) & (PROCWATCH_TABLE_SIZE - 1);
+    while (watch->table[slot] >= 0 && ret == 0)
+    {
+        if (strcmp(watch->profiles[watch->table[slot]].executable, watch->profiles[index].executable) == 0)
+            ret = -1;
+        slot = (slot + 1) & (PROCWATCH_TABLE_SIZE - 1);
+    }
+    if (ret == 0)
+        watch->table[slot] = index;
+    return ret;
+}
+
+/**
+ * @brief parses a profile line and precomputes its reports
+ * @returns 0 on success, -1 if the line is invalid
+ */
+static int parse_profile(struct procwatch* watch, const char* line, const struct protocol* protocol)
+{
+    int ret = -1;
+    struct profile* profile = &watch->profiles[watch->num_profiles];
+    char colors_str[256];
+    char brightness_str[16];
+    char mode_str[16];
+    char rest[2];
+    int fields = sscanf(line, "%63s %255s %15s %15s %1s", profile->executable, colors_str, brightness_str, mode_str, rest);
+
+    struct color colors[PROTOCOL_MAX_BATCH - 1];
+    int num_regions = 0;
+    enum brightness br = rgb;
+    enum mode md = normal;
+    if (fields >= 2 && fields <= 4 && parse_color_list(colors_str, colors, PROTOCOL_MAX_BATCH - 1, &num_regions) == 0 && num_regions > 0)
+    {
+        ret = 0;
+
+        //same argument structure as the command line: an optional brightness followed by an optional mode
+        int field = 2;
+        if (field < fields && (int)(br = parse_brightness(brightness_str)) >= 0)
+            ++field;
+        else
+            br = rgb;
+        if (field < fields)
+        {
+            md = parse_mode(field == 2 ? brightness_str : mode_str);
+            ret = (int)md >= 0 && field + 1 == fields ? 0 : -1;
+        }
+
+        if (ret == 0)
+        {
+            if (num_regions == 1 && md != gaming) //same special case as for the command line: one color is used for the first three regions
+            {
+                colors[2] = colors[1] = colors[0];
+                num_regions = 3;
+            }
+            ret = encode_state(protocol, colors, num_regions, br, md, &profile->reports);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief sends the reports of a profile unless it is already applied
+ * @returns 0 on success, -1 on error
+ */
+static int apply_profile(struct procwatch* watch, hid_device* dev, int profile)
+{
+    int ret = 0;
+    if (profile >= 0 && profile != watch->active_profile)
+    {
+        if (send_batch(dev, &watch->profiles[profile].reports) >= 0)
+        {
+            watch->active_profile = profile;
+            ++watch->switches;
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief applies the profile of the most recently started program that is still running or, if there is none, the default profile
+ */
+static int apply_current_profile(struct procwatch* watch, hid_device* dev)
+{
+    return apply_profile(watch, dev, watch->num_tracked > 0 ? watch->tracked[watch->num_tracked - 1].profile : watch->default_profile);
+}
+
+/**
+ * @brief removes a process from the tracked processes
+ * @returns true if the process was tracked
+ */
+static bool untrack(struct procwatch* watch, pid_t pid)
+{
+    bool ret = false;
+    for (int i=watch->num_tracked - 1; i>=0 && !ret; --i)
+    {
+        if (watch->tracked[i].pid == pid)
+        {
+            memmove(&watch->tracked[i], &watch->tracked[i+1], (watch->num_tracked - i - 1) * sizeof(struct tracked_process));
+            --watch->num_tracked;
+            ret = true;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief adds a process to the tracked processes if its program has a profile
+ * @returns true if the process is tracked now
+ */
+static bool track(struct procwatch* watch, pid_t pid, const char* executable)
+{
+    bool ret = false;
+    untrack(watch, pid); //a process that executes another program loses the profile of the former one
+    int profile = procwatch_lookup(watch, executable);
+    if (profile >= 0 && profile != watch->default_profile)
+    {
+        if (watch->num_tracked == PROCWATCH_MAX_TRACKED) //the oldest process is dropped if there are too many
+        {
+            memmove(&watch->tracked[0], &watch->tracked[1], (PROCWATCH_MAX_TRACKED - 1) * sizeof(struct tracked_process));
+            --watch->num_tracked;
+        }
+        watch->tracked[watch->num_tracked].pid = pid;
+        watch->tracked[watch->num_tracked].profile = profile;
+        ++watch->num_tracked;
+        ret = true;
+    }
+    return ret;
+}
+
+/**
+ * @brief compares two /proc entries by their process IDs (for scandir)
+ */
+static int compare_pids(const struct dirent** a, const struct dirent** b)
+{
+    return atoi((*a)->d_name) - atoi((*b)->d_name);
+}
+
+/**
+ * @brief tracks all already running processes that have a profile (in the order of their process IDs)
+ */
+static void scan_processes(struct procwatch* watch)
+{
+    struct dirent** entries = NULL;
+    int num_entries = scandir("/proc", &entries, NULL, compare_pids);
+    for (int i=0; i<num_entries; ++i)
+    {
+        char executable[PROCWATCH_MAX_NAME];
+        if (isdigit((byte)entries[i]->d_name[0]))
+        {
+            pid_t pid = (pid_t)atoi(entries[i]->d_name);
+            if (pid != getpid() && read_executable(pid, executable, sizeof(executable)) == 0)
+                track(watch, pid, executable);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+/**
+ * @brief opens a netlink socket and subscribes to the events of the process connector
+ * @returns the socket on success, -1 on error
+ */
+static int open_connector()
+{
+    int ret = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+    if (ret >= 0)
+    {
+        struct sockaddr_nl address;
+        memset(&address, 0, sizeof(address));
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = CN_IDX_PROC;
+        address.nl_pid = (__u32)getpid();
+
+        //the subscription message consists of the netlink header, the connector header and the operation
+        struct __attribute__((aligned(NLMSG_ALIGNTO)))
+        {
+            struct nlmsghdr header;
+            struct __attribute__((packed))
+            {
+                struct cn_msg message;
+                enum proc_cn_mcast_op operation;
+            } body;
+        } request;
+        memset(&request, 0, sizeof(request));
+        request.header.nlmsg_len = sizeof(request);
+        request.header.nlmsg_type = NLMSG_DONE;
+        request.header.nlmsg_pid = (__u32)getpid();
+        request.body.message.id.idx = CN_IDX_PROC;
+        request.body.message.id.val = CN_VAL_PROC;
+        request.body.message.len = sizeof(enum proc_cn_mcast_op);
+        request.body.operation = PROC_CN_MCAST_LISTEN;
+
+        if (bind(ret, (struct sockaddr*)&address, sizeof(address)) != 0 || send(ret, &request, sizeof(request), 0) != sizeof(request))
+        {
+            close(ret);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int procwatch_load(struct procwatch* watch, const char* path, const struct protocol* protocol)
+{
+    int ret = -1;
+    FILE* file = fopen(path, "r");
+    if (file != NULL)
+    {
+        char line[512];
+        int line_number = 0;
+        watch->num_profiles = 0;
+        watch->default_profile = -1;
+        watch->active_profile = -1;
+        watch->num_tracked = 0;
+        watch->events = 0;
+        watch->switches = 0;
+        watch->handling_ns = 0;
+        for (int i=0; i<PROCWATCH_TABLE_SIZE; ++i)
+            watch->table[i] = -1;
+        ret = 0;
+
+        while (ret == 0 && fgets(line, sizeof(line), file) != NULL)
+        {
+            ++line_number;
+            line[strcspn(line, "\r\n")] = '\0';
+            const char* content = line + strspn(line, " \t");
+            if (content[0] == '\0' || content[0] == '#')
+                continue;
+
+            if (watch->num_profiles < PROCWATCH_MAX_PROFILES && parse_profile(watch, content, protocol) == 0 && insert_profile(watch, watch->num_profiles) == 0)
+            {
+                if (strcmp(watch->profiles[watch->num_profiles].executable, PROCWATCH_DEFAULT_NAME) == 0)
+                    watch->default_profile = watch->num_profiles;
+                ++watch->num_profiles;
+            }
+            else
+            {
+                ret = line_number;
+            }
+        }
+        fclose(file);
+
+        if (ret == 0 && watch->num_profiles == 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+int procwatch_lookup(const struct procwatch* watch, const char* executable)
+{
+    int ret = -1;
+    uint32_t slot = hash_name(executable) & (PROCWATCH_TABLE_SIZE - 1);
+    while (watch->table[slot] >= 0 && ret < 0)
+    {
+        if (strcmp(watch->profiles[watch->table[slot]].executable, executable) == 0)
+            ret = watch->table[slot];
+        slot = (slot + 1) & (PROCWATCH_TABLE_SIZE - 1);
+    }
+    return ret;
+}
+
+int procwatch_exec(struct procwatch* watch, hid_device* dev, pid_t pid, const char* executable)
+{
+    bool was_tracked = watch->num_tracked > 0 && watch->tracked[watch->num_tracked - 1].pid == pid;
+    return track(watch, pid, executable) || was_tracked ? apply_current_profile(watch, dev) : 0;
+}
+
+int procwatch_exit(struct procwatch* watch, hid_device* dev, pid_t pid)
+{
+    return untrack(watch, pid) ? apply_current_profile(watch, dev) : 0;
+}
+
+int procwatch_run(struct procwatch* watch, hid_device* dev)
+{
+    int ret = -1;
+    int fd = open_connector();
+    if (fd >= 0)
+    {
+        animation_catch_signals(true);
+        scan_processes(watch);
+        ret = apply_current_profile(watch, dev);
+
+        //the socket is blocking, i.e. the watcher sleeps until the next event or signal; the remaining length stays signed, as NLMSG_NEXT() might take it below zero
+        char buffer[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+        while (ret == 0 && !animation_stop_requested())
+        {
+            ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+            if (length <= 0)
+            {
+                if (length < 0 && errno == ENOBUFS)
+                {
+                    //events were lost (e.g. the exit of a tracked process), so the tracked processes are determined from scratch
+                    watch->num_tracked = 0;
+                    scan_processes(watch);
+                    ret = apply_current_profile(watch, dev);
+                }
+                else if (length < 0 && errno != EINTR)
+                {
+                    ret = -1;
+                }
+                continue;
+            }
+
+            for (struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, length) && ret == 0; header = NLMSG_NEXT(header, length))
+            {
+                if (header->nlmsg_type == NLMSG_NOOP || header->nlmsg_type == NLMSG_ERROR)
+                    continue;
+
+                const struct cn_msg* message = (const struct cn_msg*)NLMSG_DATA(header);
+                if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC)
+                    continue;
+
+                //only processes are of interest, i.e. the events of further threads (pid != tgid) are skipped
+                const struct proc_event* event = (const struct proc_event*)message->data;
+                struct timespec start;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                if (event->what == PROC_EVENT_EXEC && event->event_data.exec.process_pid == event->event_data.exec.process_tgid)
+                {
+                    char executable[PROCWATCH_MAX_NAME];
+                    if (read_executable(event->event_data.exec.process_pid, executable, sizeof(executable)) == 0)
+                        ret = procwatch_exec(watch, dev, event->event_data.exec.process_pid, executable);
+                    ++watch->events;
+                    watch->handling_ns += nanoseconds_since(&start);
+                }
+                else if (event->what == PROC_EVENT_EXIT && event->event_data.exit.process_pid == event->event_data.exit.process_tgid)
+                {
+                    ret = procwatch_exit(watch, dev, event->event_data.exit.process_pid);
+                    ++watch->events;
+                    watch->handling_ns += nanoseconds_since(&start);
+                }
+            }
+        }
+        animation_catch_signals(false);
+        close(fd);
+    }
+    return ret;
+}
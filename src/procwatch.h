@@ -0,0 +1,109 @@
+/**
+ * @file procwatch.h
+ *
+ * @brief header file for the per-application profile switching based on the kernel's netlink process connector
+ *
+ * A profile file contains one profile per line in the format
+ *
+ *     <executable> <colors> [<brightness>] [<mode>]
+ *
+ * where the executable is the file name of the program (e.g. steam) and the remaining arguments use
+ * the same notation as the command line. The executable 'default' defines the profile that is
+ * applied while none of the configured programs is running. Empty lines and lines starting with '#'
+ * are ignored. The watcher subscribes to the exec and exit events of the process connector, i.e. it
+ * does not use any CPU time between events, looks the executable up in a hash table and sends the
+ * profile's precomputed reports.
+ */
+
+#ifndef PROCWATCH_H
+#define PROCWATCH_H
+
+#include <sys/types.h>
+#include "msiklm.h"
+#include "protocol.h"
+
+#define PROCWATCH_MAX_PROFILES  64
+#define PROCWATCH_TABLE_SIZE    128 //hash table size (power of two, at least twice the number of profiles)
+#define PROCWATCH_MAX_NAME      64
+#define PROCWATCH_MAX_TRACKED   256 //maximal number of concurrently running processes with a profile
+
+/**
+ * @brief profile struct: the state to apply while a certain program is running
+ */
+struct profile
+{
+    char executable[PROCWATCH_MAX_NAME];
+    struct report_batch reports;                 //precomputed for the keyboard's protocol
+};
+
+/**
+ * @brief tracked process struct: a running process whose program has a profile
+ */
+struct tracked_process
+{
+    pid_t pid;
+    int profile;
+};
+
+/**
+ * @brief process watcher struct: the profiles, their hash table and the running processes that have a profile
+ */
+struct procwatch
+{
+    int num_profiles;
+    int default_profile;                         //-1 if there is no default profile
+    int active_profile;                          //the currently applied profile, -1 if none has been applied yet
+    struct profile profiles[PROCWATCH_MAX_PROFILES];
+    int table[PROCWATCH_TABLE_SIZE];             //profile indices (open addressing), -1 for empty slots
+    int num_tracked;
+    struct tracked_process tracked[PROCWATCH_MAX_TRACKED];
+    unsigned long events;                        //number of handled exec and exit events
+    unsigned long switches;                      //number of applied profiles
+    long long handling_ns;                       //accumulated time to handle the events in nanoseconds
+};
+
+/**
+ * @brief loads the profiles from a file and precomputes their reports for the given protocol
+ * @param watch the process watcher
+ * @param path the path of the profile file
+ * @param protocol the protocol of the keyboard (cf. keyboard_protocol())
+ * @returns 0 on success, otherwise the (positive) line number of the first invalid line or -1 if the file could not be read or is empty
+ */
+int procwatch_load(struct procwatch* watch, const char* path, const struct protocol* protocol);
+
+/**
+ * @brief looks up the profile of an executable
+ * @param watch the process watcher
+ * @param executable the executable's file name
+ * @returns the profile's index, -1 if there is no profile for the executable
+ */
+int procwatch_lookup(const struct procwatch* watch, const char* executable);
+
+/**
+ * @brief handles the start of a program (exec) and applies its profile if there is one
+ * @param watch the process watcher
+ * @param dev the hid device
+ * @param pid the process ID
+ * @param executable the executable's file name
+ * @returns 0 on success, -1 if the profile could not be applied
+ */
+int procwatch_exec(struct procwatch* watch, hid_device* dev, pid_t pid, const char* executable);
+
+/**
+ * @brief handles the exit of a process and falls back to the most recently started profile that is still running or the default profile
+ * @param watch the process watcher
+ * @param dev the hid device
+ * @param pid the process ID
+ * @returns 0 on success, -1 if a profile could not be applied
+ */
+int procwatch_exit(struct procwatch* watch, hid_device* dev, pid_t pid);
+
+/**
+ * @brief scans the already running processes once and then handles the events of the process connector until SIGINT / SIGTERM; if events were lost, the running processes are scanned again
+ * @param watch the process watcher
+ * @param dev the hid device
+ * @returns 0 if the watcher was interrupted, -1 on error (e.g. if the process connector is not available)
+ */
+int procwatch_run(struct procwatch* watch, hid_device* dev);
+
+#endif //PROCWATCH_H
@@ -0,0 +1,239 @@
+/**
+ * @file protocol.c
+ *
+ * @brief source file that contains the protocol encoders and the device table
+ */
+
+#include "protocol.h"
+#include <string.h>
+
+#define PER_KEY_REPORT_ID    0x0e
+#define PER_KEY_APPLY_ID     0x0d
+#define PER_KEY_HEADER_SIZE  4
+#define PER_KEY_ENTRY_SIZE   4
+#define PER_KEY_APPLY_SIZE   64
+#define PER_KEY_REGION_KEYS  64 //maximal number of keys of an emulated region
+
+/**
+ * @brief HID usage IDs of the keys of the left region of per-key keyboards (US layout)
+ */
+static const byte left_keys[] =
+{
+    0x29, 0x3a, 0x3b, 0x3c, 0x3d,               //Esc, F1-F4
+    0x35, 0x1e, 0x1f, 0x20, 0x21, 0x22,         //`, 1-5
+    0x2b, 0x14, 0x1a, 0x08, 0x15, 0x17,         //Tab, Q, W, E, R, T
+    0x39, 0x04, 0x16, 0x07, 0x09, 0x0a,         //Caps Lock, A, S, D, F, G
+    0xe1, 0x1d, 0x1b, 0x06, 0x19, 0x05,         //left Shift, Z, X, C, V, B
+    0xe0, 0xe3, 0xe2                            //left Ctrl, left GUI, left Alt
+};
+
+/**
+ * @brief HID usage IDs of the keys of the middle region of per-key keyboards (US layout)
+ */
+static const byte middle_keys[] =
+{
+    0x3e, 0x3f, 0x40, 0x41,                     //F5-F8
+    0x23, 0x24, 0x25, 0x26, 0x27,               //6-0
+    0x1c, 0x18, 0x0c, 0x12, 0x13,               //Y, U, I, O, P
+    0x0b, 0x0d, 0x0e, 0x0f,                     //H, J, K, L
+    0x11, 0x10, 0x36, 0x37,                     //N, M, comma, period
+    0x2c                                        //space
+};
+
+/**
+ * @brief HID usage IDs of the keys of the right region of per-key keyboards (US layout)
+ */
+static const byte right_keys[] =
+{
+    0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,   //F9-F12, Print, Scroll Lock, Pause
+    0x2d, 0x2e, 0x2a,                           //minus, equal, Backspace
+    0x2f, 0x30, 0x31,                           //brackets, backslash
+    0x33, 0x34, 0x28,                           //semicolon, apostrophe, Enter
+    0x38, 0xe5, 0xe6, 0xe4,                     //slash, right Shift, right Alt, right Ctrl
+    0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e,         //Insert, Home, Page Up, Delete, End, Page Down
+    0x4f, 0x50, 0x51, 0x52                      //arrow keys
+};
+
+/**
+ * @brief encode_color() of the region protocol: {1, 2, command, region, values..., 236}
+ */
+static int region_encode_color(byte* buffer, struct color color, enum region region, enum brightness brightness)
+{
+    buffer[0] = 1;
+    buffer[1] = 2;
+    buffer[3] = (byte)region;
+    buffer[7] = 236; //EOR (end of request)
+
+    if (brightness == rgb) //full rgb selection -> rgb-command
+    {
+        buffer[2] = 64; //rgb
+        buffer[4] = color.red;
+        buffer[5] = color.green;
+        buffer[6] = color.blue;
+    }
+    else //predefined color with explicit brightness -> set-command
+    {
+        buffer[2] = 66; //set
+        buffer[4] = brightness != off ? (byte)color.profile : 0;
+        buffer[5] = (byte)brightness;
+        buffer[6] = 0;
+    }
+    return 8;
+}
+
+/**
+ * @brief encode_mode() of the region protocol: the commit request that also selects the hardware mode
+ */
+static int region_encode_mode(byte* buffer, enum mode mode)
+{
+    buffer[0] = 1;
+    buffer[1] = 2;
+    buffer[2] = 65; //commit
+    buffer[3] = (byte)mode; //set hardware mode
+    buffer[4] = 0;
+    buffer[5] = 0;
+    buffer[6] = 0;
+    buffer[7] = 236; //EOR (end of request)
+    return 8;
+}
+
+/**
+ * @brief encode_keys() of the per-key protocol: {0x0e, 0, count (little endian), count * {key, red, green, blue}, zero padding}
+ */
+static int per_key_encode_keys(byte* buffer, const struct key_color* keys, int num_keys)
+{
+    int ret = -1;
+    if (num_keys >= 0 && num_keys <= per_key_protocol.max_keys_per_report)
+    {
+        memset(buffer, 0, PROTOCOL_MAX_REPORT_SIZE);
+        buffer[0] = PER_KEY_REPORT_ID;
+        buffer[2] = (byte)(num_keys & 0xff);
+        buffer[3] = (byte)(num_keys >> 8);
+
+        byte* entry = &buffer[PER_KEY_HEADER_SIZE];
+        for (int i=0; i<num_keys; ++i, entry += PER_KEY_ENTRY_SIZE)
+        {
+            entry[0] = keys[i].key;
+            entry[1] = keys[i].red;
+            entry[2] = keys[i].green;
+            entry[3] = keys[i].blue;
+        }
+        ret = PROTOCOL_MAX_REPORT_SIZE; //the report always has its full size
+    }
+    return ret;
+}
+
+/**
+ * @brief encode_color() of the per-key protocol: emulates a region by setting all of its keys in a single report; there is nothing to send for the logo, front and mouse regions
+ */
+static int per_key_encode_color(byte* buffer, struct color color, enum region region, enum brightness brightness)
+{
+    const byte* region_keys = NULL;
+    int num_keys = 0;
+    switch (region)
+    {
+        case left:   region_keys = left_keys;   num_keys = sizeof(left_keys);   break;
+        case middle: region_keys = middle_keys; num_keys = sizeof(middle_keys); break;
+        case right:  region_keys = right_keys;  num_keys = sizeof(right_keys);  break;
+        default: break;
+    }
+
+    int ret = 0;
+    if (region_keys != NULL)
+    {
+        //there is no firmware brightness, so the predefined brightnesses are emulated by scaling the color
+        int scale = brightness == rgb || brightness == high ? 3 : brightness == medium ? 2 : brightness == low ? 1 : 0;
+        struct key_color keys[PER_KEY_REGION_KEYS];
+        for (int i=0; i<num_keys; ++i)
+        {
+            keys[i].key = region_keys[i];
+            keys[i].red = (byte)(color.red * scale / 3);
+            keys[i].green = (byte)(color.green * scale / 3);
+            keys[i].blue = (byte)(color.blue * scale / 3);
+        }
+        ret = per_key_encode_keys(buffer, keys, num_keys);
+    }
+    return ret;
+}
+
+/**
+ * @brief encode_mode() of the per-key protocol: there are no firmware modes, so every mode just applies the sent colors
+ */
+static int per_key_encode_mode(byte* buffer, enum mode mode)
+{
+    int ret = -1;
+    if (mode >= normal && mode <= wave)
+    {
+        memset(buffer, 0, PER_KEY_APPLY_SIZE);
+        buffer[0] = PER_KEY_APPLY_ID;
+        ret = PER_KEY_APPLY_SIZE;
+    }
+    return ret;
+}
+
+const struct protocol region_protocol =
+{
+    "MSI region",
+    0,
+    region_encode_color,
+    region_encode_mode,
+    NULL
+};
+
+const struct protocol per_key_protocol =
+{
+    "SteelSeries per-key",
+    (PROTOCOL_MAX_REPORT_SIZE - PER_KEY_HEADER_SIZE) / PER_KEY_ENTRY_SIZE,
+    per_key_encode_color,
+    per_key_encode_mode,
+    per_key_encode_keys
+};
+
+const struct device device_table[] =
+{
+    { 0x1770, 0xff00, "MSI SteelSeries keyboard (regions)", &region_protocol,  true  },
+    { 0x1038, 0x1122, "MSI SteelSeries keyboard (per-key)", &per_key_protocol, false }, //unverified layout
+    { 0,      0,      NULL,                                 NULL,              false }
+};
+
+const struct device* find_device(unsigned short vendor_id, unsigned short product_id)
+{
+    const struct device* ret = NULL;
+    for (const struct device* device = device_table; device->protocol != NULL && ret == NULL; ++device)
+        if (device->vendor_id == vendor_id && device->product_id == product_id)
+            ret = device;
+    return ret;
+}
+
+int encode_state(const struct protocol* protocol, const struct color* colors, int num_regions, enum brightness brightness, enum mode mode, struct report_batch* batch)
+{
+    int ret = num_regions >= 0 && num_regions < PROTOCOL_MAX_BATCH ? 0 : -1;
+    batch->num_reports = 0;
+    for (int i=0; i<num_regions && ret == 0; ++i)
+    {
+        //same validity rule as set_color(): an explicit brightness is only valid for predefined colors
+        int length = brightness == rgb || brightness == off || colors[i].profile != custom ? protocol->encode_color(batch->reports[batch->num_reports], colors[i], i+1, brightness) : -1;
+        if (length > 0)
+            batch->lengths[batch->num_reports++] = length;
+        else if (length < 0)
+            ret = -1;
+    }
+
+    if (ret == 0)
+    {
+        int length = protocol->encode_mode(batch->reports[batch->num_reports], mode);
+        if (length > 0)
+            batch->lengths[batch->num_reports++] = length;
+        else
+            ret = -1;
+    }
+    return ret;
+}
+
+int send_batch(hid_device* dev, const struct report_batch* batch)
+{
+    int ret = 0;
+    for (int i=0; i<batch->num_reports && ret >= 0; ++i)
+        ret = send_report(dev, batch->reports[i], batch->lengths[i]) > 0 ? ret + 1 : -1;
+    return ret;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file protocol.h
+ *
+ * @brief header file for the protocol encoders that translate colors and modes into the feature reports of a certain keyboard
+ *
+ * The encoder is selected by the vendor and product ID of the detected keyboard using a compile-time
+ * device table. Two encoders are available:
+ *
+ *  - the region protocol of the MSI SteelSeries keyboards (one 8-byte report per region, committed by a mode report)
+ *  - a SteelSeries-style per-key protocol that packs many keys into one large report, i.e. a full
+ *    keyboard update requires only a few transfers instead of one per key
+ *
+ * The layout of the per-key protocol has not been verified on hardware yet, so its keyboards are only
+ * tried if the environment variable MSIKLM_UNVERIFIED is set. It has no firmware modes and no logo,
+ * front or mouse regions: every mode just applies the sent colors and these regions are skipped.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include "msiklm.h"
+
+#define PROTOCOL_MAX_REPORT_SIZE 524
+#define PROTOCOL_MAX_BATCH       8   //seven regions and the commit
+#define PROTOCOL_UNVERIFIED_ENV  "MSIKLM_UNVERIFIED"
+
+/**
+ * @brief protocol struct: the encoder functions of a keyboard protocol
+ *
+ * Each encoder writes a complete feature report into the buffer (at least PROTOCOL_MAX_REPORT_SIZE
+ * bytes) and returns its length, 0 if nothing has to be sent or -1 if the request is not supported.
+ */
+struct protocol
+{
+    const char* name;
+    int max_keys_per_report;                                                                   //0 if per-key colors are not supported
+    int (*encode_color)(byte* buffer, struct color color, enum region region, enum brightness brightness);
+    int (*encode_mode)(byte* buffer, enum mode mode);
+    int (*encode_keys)(byte* buffer, const struct key_color* keys, int num_keys);             //encodes at most max_keys_per_report keys
+};
+
+/**
+ * @brief device struct: an entry of the device table
+ */
+struct device
+{
+    unsigned short vendor_id;
+    unsigned short product_id;
+    const char* name;
+    const struct protocol* protocol;
+    bool verified;                                                                             //false if the device is only tried if PROTOCOL_UNVERIFIED_ENV is set
+};
+
+/**
+ * @brief report batch struct: ready-to-send feature reports of a complete state, e.g. precomputed for a profile
+ */
+struct report_batch
+{
+    int num_reports;
+    int lengths[PROTOCOL_MAX_BATCH];
+    byte reports[PROTOCOL_MAX_BATCH][PROTOCOL_MAX_REPORT_SIZE];
+};
+
+/**
+ * @brief the region protocol of the MSI SteelSeries keyboards
+ */
+extern const struct protocol region_protocol;
+
+/**
+ * @brief the SteelSeries-style per-key protocol
+ */
+extern const struct protocol per_key_protocol;
+
+/**
+ * @brief the device table: all supported keyboards (terminated by an entry with a null protocol)
+ */
+extern const struct device device_table[];
+
+/**
+ * @brief searches the device table
+ * @param vendor_id the vendor ID
+ * @param product_id the product ID
+ * @returns the respective device or null if the device is not supported
+ */
+const struct device* find_device(unsigned short vendor_id, unsigned short product_id);
+
+/**
+ * @brief encodes a complete state (colors of the first regions and the committing mode) into a report batch; regions the protocol does not have are skipped
+ * @param protocol the protocol
+ * @param colors the colors starting with the left region
+ * @param num_regions the number of colors (at most PROTOCOL_MAX_BATCH - 1)
+ * @param brightness the brightness
+ * @param mode the mode
+ * @param batch the encoded reports
+ * @returns 0 on success, -1 if the state is invalid or not supported by the protocol
+ */
+int encode_state(const struct protocol* protocol, const struct color* colors, int num_regions, enum brightness brightness, enum mode mode, struct report_batch* batch);
+
+/**
+ * @brief sends all reports of a batch without any further computation
+ * @param dev the hid device
+ * @param batch the report batch
+ * @returns the number of sent reports, -1 on error
+ */
+int send_batch(hid_device* dev, const struct report_batch* batch);
+
+#endif //PROTOCOL_H
@@ -0,0 +1,138 @@
+/**
+ * @file realtime.c
+ *
+ * @brief source file that contains the real-time profile and the jitter histogram
+ */
+
+#define _GNU_SOURCE //CPU affinity
+#include "realtime.h"
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PREFAULT_STACK_SIZE (256 * 1024)
+#define JITTER_BAR_WIDTH    40
+
+/**
+ * @brief touches the given amount of stack, such that the pages are present (and locked) before the frame loop needs them
+ */
+static void prefault_stack()
+{
+    volatile unsigned char stack[PREFAULT_STACK_SIZE];
+    for (size_t i=0; i<sizeof(stack); i+=4096)
+        stack[i] = 0;
+}
+
+void realtime_options_init(struct realtime_options* options)
+{
+    options->policy = realtime_none;
+    options->priority = REALTIME_DEFAULT_PRIORITY;
+    options->cpu = -1;
+    options->lock_memory = false;
+}
+
+enum realtime_policy parse_realtime_policy(const char* policy_str)
+{
+    enum realtime_policy ret = -1;
+    if (policy_str != NULL)
+    {
+        if (strcmp(policy_str, "fifo") == 0)
+            ret = realtime_fifo;
+        else if (strcmp(policy_str, "rr") == 0)
+            ret = realtime_rr;
+    }
+    return ret;
+}
+
+int realtime_enter(const struct realtime_options* options)
+{
+    int ret = 0;
+    if (options->lock_memory)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+            prefault_stack();
+        else
+            ret = -1;
+    }
+
+    if (options->cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(options->cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            ret = -1;
+    }
+
+    if (options->policy != realtime_none)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options->priority;
+        if (sched_setscheduler(0, options->policy == realtime_fifo ? SCHED_FIFO : SCHED_RR, &param) != 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+void realtime_leave(const struct realtime_options* options)
+{
+    if (options->policy != realtime_none)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        sched_setscheduler(0, SCHED_OTHER, &param);
+    }
+    if (options->lock_memory)
+        munlockall();
+}
+
+void jitter_reset(struct jitter_histogram* histogram)
+{
+    memset(histogram, 0, sizeof(struct jitter_histogram));
+}
+
+void jitter_record(struct jitter_histogram* histogram, const struct timespec* deadline, const struct timespec* actual)
+{
+    long long delay = (long long)(actual->tv_sec - deadline->tv_sec) * 1000000000LL + (actual->tv_nsec - deadline->tv_nsec);
+    if (delay < 0)
+        delay = 0;
+
+    //logarithmic buckets: bucket i counts delays below 2^i microseconds
+    int bucket = 0;
+    for (long long us = delay / 1000; us > 0 && bucket < JITTER_BUCKETS - 1; us >>= 1)
+        ++bucket;
+
+    ++histogram->buckets[bucket];
+    ++histogram->frames;
+    histogram->total_ns += delay;
+    if (delay > histogram->max_ns)
+        histogram->max_ns = delay;
+}
+
+void jitter_print(const struct jitter_histogram* histogram)
+{
+    printf("jitter: %lu frames, avg. %.1f us, max. %.1f us\n", histogram->frames,
+           histogram->frames > 0 ? (double)histogram->total_ns / histogram->frames / 1000 : 0.0, (double)histogram->max_ns / 1000);
+
+    unsigned long largest = 0;
+    for (int i=0; i<JITTER_BUCKETS; ++i)
+        if (histogram->buckets[i] > largest)
+            largest = histogram->buckets[i];
+
+    for (int i=0; i<JITTER_BUCKETS && largest > 0; ++i)
+    {
+        if (histogram->buckets[i] == 0)
+            continue;
+
+        char bar[JITTER_BAR_WIDTH + 1];
+        int width = (int)((histogram->buckets[i] * JITTER_BAR_WIDTH + largest - 1) / largest);
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        if (i == JITTER_BUCKETS - 1)
+            printf("  >= %8ld us %10lu %s\n", 1L << (i - 1), histogram->buckets[i], bar);
+        else
+            printf("  <  %8ld us %10lu %s\n", 1L << i, histogram->buckets[i], bar);
+    }
+}
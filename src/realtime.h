@@ -0,0 +1,101 @@
+/**
+ * @file realtime.h
+ *
+ * @brief header file for the optional real-time profile of the frame loop and its jitter measurement
+ *
+ * The real-time profile runs the frame loop with a real-time scheduling policy (SCHED_FIFO or
+ * SCHED_RR), optionally pins it to a single CPU and locks all current and future pages into memory;
+ * the stack is prefaulted, so the frame loop itself does not page-fault. It is not allocation-free,
+ * though: hidapi-libusb allocates a libusb transfer for every feature report it sends. This requires
+ * root (or CAP_SYS_NICE and CAP_IPC_LOCK). The jitter histogram records how late each frame is sent
+ * relative to its original deadline.
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#define REALTIME_DEFAULT_PRIORITY 50
+#define JITTER_BUCKETS            22 //bucket 0: below 1 us, bucket i: below 2^i us, the last bucket collects everything beyond
+
+/**
+ * @brief real-time policy enum: the scheduling policy of the frame loop
+ */
+enum realtime_policy
+{
+    realtime_none = 0,             //normal scheduling
+    realtime_fifo = 1,             //SCHED_FIFO
+    realtime_rr   = 2              //SCHED_RR
+};
+
+/**
+ * @brief real-time options struct: configures the real-time profile
+ */
+struct realtime_options
+{
+    enum realtime_policy policy;
+    int priority;                  //real-time priority (1 to 99)
+    int cpu;                       //CPU to pin the frame loop to, -1 to keep the affinity
+    bool lock_memory;              //lock all pages into memory and prefault the stack
+};
+
+/**
+ * @brief jitter histogram struct: distribution of the delays between the frame deadlines and the actual send times
+ */
+struct jitter_histogram
+{
+    unsigned long buckets[JITTER_BUCKETS];
+    unsigned long frames;
+    long long total_ns;
+    long long max_ns;
+};
+
+/**
+ * @brief initializes the real-time options with their default values (normal scheduling)
+ * @param options the options to initialize
+ */
+void realtime_options_init(struct realtime_options* options);
+
+/**
+ * @brief parses a real-time policy (fifo or rr)
+ * @param policy_str the policy as a string (might be null)
+ * @returns the respective real-time policy, -1 if it is invalid
+ */
+enum realtime_policy parse_realtime_policy(const char* policy_str);
+
+/**
+ * @brief applies the real-time profile to the calling thread
+ * @param options the real-time options; nothing is done for the normal policy without pinning and memory locking
+ * @returns 0 on success, -1 if any part of the profile could not be applied (the remaining parts are still applied)
+ */
+int realtime_enter(const struct realtime_options* options);
+
+/**
+ * @brief reverts realtime_enter(): normal scheduling and unlocked memory (the CPU affinity is kept)
+ * @param options the real-time options passed to realtime_enter()
+ */
+void realtime_leave(const struct realtime_options* options);
+
+/**
+ * @brief clears a jitter histogram
+ * @param histogram the histogram
+ */
+void jitter_reset(struct jitter_histogram* histogram);
+
+/**
+ * @brief records the delay of a frame
+ * @param histogram the histogram
+ * @param deadline the frame's deadline
+ * @param actual the point in time when the frame was actually sent
+ */
+void jitter_record(struct jitter_histogram* histogram, const struct timespec* deadline, const struct timespec* actual);
+
+/**
+ * @brief prints a jitter histogram to stdout
+ * @param histogram the histogram
+ */
+void jitter_print(const struct jitter_histogram* histogram);
+
+#endif //REALTIME_H
@@ -0,0 +1,324 @@
+/**
+ * @file schedule.c
+ *
+ * @brief source file that contains the time-of-day schedules
+ */
+
+#include "schedule.h"
+#include "animation.h"
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/**
+ * @brief compares two schedule entries by their start time (for qsort)
+ */
+static int compare_entries(const void* a, const void* b)
+{
+    return ((const struct schedule_entry*)a)->start - ((const struct schedule_entry*)b)->start;
+}
+
+/**
+ * @brief converts a timespec into seconds since the epoch
+ */
+static double to_seconds(const struct timespec* time)
+{
+    return (double)time->tv_sec + (double)time->tv_nsec / 1e9;
+}
+
+/**
+ * @brief converts seconds since the epoch into a timespec
+ */
+static struct timespec to_timespec(double seconds)
+{
+    struct timespec ret;
+    ret.tv_sec = (time_t)floor(seconds);
+    ret.tv_nsec = (long)ceil((seconds - floor(seconds)) * 1e9); //round up such that a deadline never expires before the point in time
+    if (ret.tv_nsec >= 1000000000L)
+        ret.tv_nsec = 999999999L;
+    return ret;
+}
+
+/**
+ * @brief converts a time of day on a local date into seconds since the epoch; days are not assumed to have 24 hours (daylight saving time)
+ * @param date the local date
+ * @param days the number of days that are added to the date (e.g. -1 for the day before)
+ * @param time_of_day the wall-clock time in seconds since midnight
+ */
+static double local_time(const struct tm* date, int days, int time_of_day)
+{
+    struct tm local;
+    memset(&local, 0, sizeof(local));
+    local.tm_year = date->tm_year;
+    local.tm_mon = date->tm_mon;
+    local.tm_mday = date->tm_mday + days; //normalized by mktime()
+    local.tm_hour = time_of_day / 3600;
+    local.tm_min = time_of_day / 60 % 60;
+    local.tm_sec = time_of_day % 60;
+    local.tm_isdst = -1; //let mktime() determine whether daylight saving time is in effect at that time
+    return (double)mktime(&local);
+}
+
+/**
+ * @brief linearly interpolates a single channel and rounds the result
+ */
+static byte interpolate(byte from, byte to, double f)
+{
+    return (byte)floor(from + (to - from) * f + 0.5);
+}
+
+/**
+ * @brief wait_until() of the default clock: sleeps on the timerfd (passed as context) until the absolute deadline
+ */
+static int timerfd_wait_until(void* context, const struct timespec* deadline)
+{
+    int ret = -1;
+    int fd = (int)(intptr_t)context;
+    struct itimerspec timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value = *deadline;
+
+    //a deadline in the past expires immediately; setting the realtime clock cancels the timer such that the deadline can be recomputed
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &timer, NULL) == 0)
+    {
+        uint64_t expirations = 0;
+        if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            ret = 0;
+        else if (errno == ECANCELED)
+            ret = 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief now() of the default clock: returns the current realtime
+ */
+static int realtime_now(void* context, struct timespec* now)
+{
+    (void)context;
+    return clock_gettime(CLOCK_REALTIME, now);
+}
+
+int schedule_load(struct schedule* schedule, const char* path)
+{
+    int ret = -1;
+    FILE* file = fopen(path, "r");
+    if (file != NULL)
+    {
+        char line[512];
+        int line_number = 0;
+        schedule->num_entries = 0;
+        ret = 0;
+
+        while (ret == 0 && fgets(line, sizeof(line), file) != NULL)
+        {
+            ++line_number;
+            line[strcspn(line, "\r\n")] = '\0';
+            const char* content = line + strspn(line, " \t");
+            if (content[0] == '\0' || content[0] == '#')
+                continue;
+
+            int hours = -1, minutes = -1, transition = 0;
+            char colors_str[256];
+            char rest[2];
+            int fields = sscanf(content, "%d:%d %255s %d %1s", &hours, &minutes, colors_str, &transition, rest);
+
+            struct schedule_entry* entry = &schedule->entries[schedule->num_entries];
+            if ((fields == 3 || fields == 4) && hours >= 0 && hours < 24 && minutes >= 0 && minutes < 60 &&
+                transition >= 0 && transition <= 24 * 60 && schedule->num_entries < SCHEDULE_MAX_ENTRIES &&
+                parse_color_list(colors_str, entry->colors, SCHEDULE_MAX_REGIONS, &entry->num_regions) == 0 && entry->num_regions > 0)
+            {
+                if (entry->num_regions == 1) //same special case as for the command line: one color is used for the first three regions
+                {
+                    entry->colors[2] = entry->colors[1] = entry->colors[0];
+                    entry->num_regions = 3;
+                }
+                entry->start = hours * 3600 + minutes * 60;
+                entry->transition = transition * 60;
+                ++schedule->num_entries;
+            }
+            else
+            {
+                ret = line_number;
+            }
+        }
+        fclose(file);
+
+        if (ret == 0 && schedule->num_entries == 0)
+            ret = -1;
+        if (ret == 0)
+            qsort(schedule->entries, schedule->num_entries, sizeof(struct schedule_entry), compare_entries);
+    }
+    return ret;
+}
+
+double schedule_evaluate(const struct schedule* schedule, double t, struct color* colors, int* num_regions)
+{
+    //entries start at a wall-clock time, so each start is converted on its local date
+    time_t seconds = (time_t)floor(t);
+    struct tm date;
+    localtime_r(&seconds, &date);
+
+    //the active entry is the last one that started today, or the last one of yesterday if none started yet; the next one follows it or is the first one of tomorrow
+    int active = schedule->num_entries - 1;
+    double active_start = local_time(&date, -1, schedule->entries[active].start);
+    double ret = local_time(&date, 1, schedule->entries[0].start);
+    for (int i=0; i<schedule->num_entries; ++i)
+    {
+        double start = local_time(&date, 0, schedule->entries[i].start);
+        if (start > t)
+        {
+            ret = start;
+            break;
+        }
+        active = i;
+        active_start = start;
+    }
+
+    const struct schedule_entry* entry = &schedule->entries[active];
+    const struct schedule_entry* previous = &schedule->entries[(active + schedule->num_entries - 1) % schedule->num_entries];
+
+    double elapsed = t - active_start;
+    bool in_transition = entry->transition > 0 && elapsed < entry->transition;
+    int steps = 0;
+
+    *num_regions = entry->num_regions;
+    for (int i=0; i<entry->num_regions; ++i)
+    {
+        colors[i] = entry->colors[i];
+        if (in_transition && i < previous->num_regions)
+        {
+            const struct color* from = &previous->colors[i];
+            const struct color* to = &entry->colors[i];
+            double f = elapsed / entry->transition;
+            colors[i].profile = custom;
+            colors[i].red = interpolate(from->red, to->red, f);
+            colors[i].green = interpolate(from->green, to->green, f);
+            colors[i].blue = interpolate(from->blue, to->blue, f);
+
+            //the channel with the largest difference determines how often a step is due
+            int deltas[3] = { abs(to->red - from->red), abs(to->green - from->green), abs(to->blue - from->blue) };
+            for (int c=0; c<3; ++c)
+                if (deltas[c] > steps)
+                    steps = deltas[c];
+        }
+    }
+
+    if (in_transition)
+    {
+        double step_time = active_start + entry->transition;
+        if (steps > 0)
+        {
+            double interval = (double)entry->transition / steps;
+            double candidate = active_start + (floor(elapsed / interval + 1e-6) + 1) * interval; //tolerance: t usually is the previous step's deadline
+            if (candidate < step_time)
+                step_time = candidate;
+        }
+        if (step_time < ret)
+            ret = step_time;
+    }
+    return ret;
+}
+
+int schedule_clock_init(struct schedule_clock* clock)
+{
+    int ret = -1;
+    int fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    if (fd >= 0)
+    {
+        clock->context = (void*)(intptr_t)fd;
+        clock->now = realtime_now;
+        clock->wait_until = timerfd_wait_until;
+        ret = 0;
+    }
+    return ret;
+}
+
+void schedule_clock_close(struct schedule_clock* clock)
+{
+    close((int)(intptr_t)clock->context);
+}
+
+int schedule_run(hid_device* dev, const struct schedule* schedule, const struct schedule_clock* clock, struct schedule_stats* stats)
+{
+    int ret = schedule->num_entries > 0 ? 0 : -1;
+    struct schedule_stats local_stats;
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(struct schedule_stats));
+
+    struct color colors[SCHEDULE_MAX_REGIONS];
+    struct color sent[SCHEDULE_MAX_REGIONS];
+    bool sent_valid[SCHEDULE_MAX_REGIONS] = { false };
+    int num_regions = 0;
+    struct timespec now;
+
+    animation_catch_signals(true);
+    while (ret == 0 && !animation_stop_requested())
+    {
+        if (clock->now(clock->context, &now) != 0)
+        {
+            ret = -1;
+            break;
+        }
+        double next = schedule_evaluate(schedule, to_seconds(&now), colors, &num_regions);
+
+        //send only the regions that changed, the commit is only required if anything changed at all
+        int reports = 0;
+        for (int i=0; i<num_regions && ret == 0; ++i)
+        {
+            if (!sent_valid[i] || colors[i].red != sent[i].red || colors[i].green != sent[i].green || colors[i].blue != sent[i].blue)
+            {
+                int length = set_color(dev, colors[i], i+1, rgb);
+                if (length >= 0) //nothing is sent for regions the keyboard does not have
+                {
+                    sent[i] = colors[i];
+                    sent_valid[i] = true;
+                    if (length > 0)
+                        ++reports;
+                }
+                else
+                {
+                    ret = -1;
+                }
+            }
+        }
+        if (ret == 0 && reports > 0)
+        {
+            if (set_mode(dev, normal) > 0)
+                ++reports;
+            else
+                ret = -1;
+        }
+        stats->reports += reports;
+
+        if (ret == 0)
+        {
+            struct timespec deadline = to_timespec(next);
+            int woken = clock->wait_until(clock->context, &deadline);
+            if (woken < 0)
+            {
+                if (!animation_stop_requested())
+                    ret = -1;
+            }
+            else
+            {
+                ++stats->wakeups;
+                if (woken == 0 && clock->now(clock->context, &now) == 0)
+                {
+                    double lateness = to_seconds(&now) - next;
+                    stats->total_lateness += lateness;
+                    if (lateness > stats->max_lateness)
+                        stats->max_lateness = lateness;
+                }
+            }
+        }
+    }
+    animation_catch_signals(false);
+    return ret;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file schedule.h
+ *
+ * @brief header file for time-of-day schedules that are applied by a long-running process without any polling
+ *
+ * A schedule file contains one entry per line in the format
+ *
+ *     <HH:MM> <colors> [<transition minutes>]
+ *
+ * where the colors use the same notation as the command line and the optional transition fades
+ * from the previous entry's colors to the entry's colors, starting at the entry's time. Empty
+ * lines and lines starting with '#' are ignored. The process sleeps on absolute timer deadlines
+ * and only wakes up when an entry starts or a transition step is due.
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <time.h>
+#include "msiklm.h"
+
+#define SCHEDULE_MAX_ENTRIES 64
+#define SCHEDULE_MAX_REGIONS 7
+
+/**
+ * @brief schedule entry struct: the colors that are applied from a certain time of day on
+ */
+struct schedule_entry
+{
+    int start;                                   //wall-clock time in seconds since midnight (local time, also on days with a daylight saving time change)
+    int transition;                              //duration of the transition in seconds, 0 switches instantly
+    int num_regions;                             //regions beyond num_regions are left unchanged
+    struct color colors[SCHEDULE_MAX_REGIONS];
+};
+
+/**
+ * @brief schedule struct: all entries sorted by their start time
+ */
+struct schedule
+{
+    int num_entries;
+    struct schedule_entry entries[SCHEDULE_MAX_ENTRIES];
+};
+
+/**
+ * @brief schedule clock struct: the clock a schedule runs on; replaceable such that the runner can be driven by a simulated clock
+ */
+struct schedule_clock
+{
+    void* context;
+    int (*now)(void* context, struct timespec* now);                          //returns the current realtime, 0 on success
+    int (*wait_until)(void* context, const struct timespec* deadline);        //sleeps until the absolute realtime deadline, 0 on success, 1 if the clock was set (the deadline has to be recomputed), -1 on error or interruption
+};
+
+/**
+ * @brief schedule statistics struct: accuracy and cost of running a schedule
+ */
+struct schedule_stats
+{
+    unsigned long wakeups;                       //number of wakeups (timer expirations and clock changes)
+    unsigned long reports;                       //number of sent feature reports
+    double max_lateness;                         //maximal delay between a deadline and the actual wakeup in seconds
+    double total_lateness;                       //accumulated delay in seconds
+};
+
+/**
+ * @brief loads a schedule from a file
+ * @param schedule the schedule
+ * @param path the path of the schedule file
+ * @returns 0 on success, otherwise the (positive) line number of the first invalid line or -1 if the file could not be read or is empty
+ */
+int schedule_load(struct schedule* schedule, const char* path);
+
+/**
+ * @brief evaluates the schedule at the given point in time
+ * @param schedule the schedule (containing at least one entry)
+ * @param t the point in time (seconds since the epoch, including fractions)
+ * @param colors the colors of all regions at the given point in time
+ * @param num_regions the number of regions that are defined at the given point in time
+ * @returns the next point in time where the colors change (seconds since the epoch), i.e. the next transition step or the start of the next entry
+ */
+double schedule_evaluate(const struct schedule* schedule, double t, struct color* colors, int* num_regions);
+
+/**
+ * @brief initializes the default clock which sleeps on a timerfd with an absolute CLOCK_REALTIME deadline that is cancelled if the clock is set
+ * @param clock the clock
+ * @returns 0 on success, -1 if the timerfd could not be created
+ */
+int schedule_clock_init(struct schedule_clock* clock);
+
+/**
+ * @brief releases the resources of the default clock
+ * @param clock the clock
+ */
+void schedule_clock_close(struct schedule_clock* clock);
+
+/**
+ * @brief runs the schedule until SIGINT / SIGTERM: applies the current state, sleeps until the next change and sends only changed regions
+ * @param dev the hid device
+ * @param schedule the schedule
+ * @param clock the clock
+ * @param stats the statistics (might be null); they are reset in advance
+ * @returns 0 if the schedule was interrupted, -1 on error
+ */
+int schedule_run(hid_device* dev, const struct schedule* schedule, const struct schedule_clock* clock, struct schedule_stats* stats);
+
+#endif //SCHEDULE_H
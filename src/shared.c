@@ -0,0 +1,403 @@
+/**
+ * @file shared.c
+ *
+ * @brief source file that contains the shared-memory region state and its seqlock
+ */
+
+#include "shared.h"
+#include "animation.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REGION_SET_FLAG 0x80000000u
+
+#define SEQUENCE_OF(word) ((unsigned int)(word))        //the sequence counter of a sequence word
+#define WRITER_OF(word)   ((pid_t)((word) >> 32))        //the writer's pid of a sequence word
+
+/**
+ * @brief stale watch struct: observes an odd sequence to detect a writer that was killed while publishing
+ */
+struct stale_watch
+{
+    bool active;
+    unsigned long long sequence;
+    struct timespec since;
+};
+
+static int segment_fd = -1;      //the mapped segment (kept open to detect a truncation)
+static sigjmp_buf bus_error_jump; //where an access to a concurrently truncated segment continues
+static volatile sig_atomic_t bus_error_armed = 0; //true while the flusher accesses the segment within guarded_check()
+static atomic_int writer_pid = 0; //the cached pid of this process, 0 if it has to be determined (again)
+
+/**
+ * @brief forgets the cached pid in a forked child
+ */
+static void forget_writer_pid()
+{
+    atomic_store_explicit(&writer_pid, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief registers forget_writer_pid() as fork handler
+ */
+static void register_fork_handler()
+{
+    pthread_atfork(NULL, NULL, forget_writer_pid);
+}
+
+/**
+ * @brief returns the pid of this process; getpid() is a syscall, so it is cached to keep publishing free of syscalls
+ */
+static pid_t current_writer()
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, register_fork_handler);
+    pid_t ret = atomic_load_explicit(&writer_pid, memory_order_relaxed);
+    if (ret == 0)
+    {
+        ret = getpid();
+        atomic_store_explicit(&writer_pid, ret, memory_order_relaxed);
+    }
+    return ret;
+}
+
+/**
+ * @brief packs a sequence counter and the pid of its writer into a sequence word
+ */
+static unsigned long long sequence_word(unsigned int sequence, pid_t writer)
+{
+    return ((unsigned long long)(unsigned int)writer << 32) | sequence;
+}
+
+/**
+ * @brief checks if the process of a writer does not exist anymore (a process of another user still exists, kill() just fails with EPERM)
+ */
+static bool writer_dead(pid_t writer)
+{
+    return writer <= 0 || (kill(writer, 0) == -1 && errno == ESRCH);
+}
+
+/**
+ * @brief packs a color into a single word including the set flag
+ */
+static unsigned int pack_region(struct color color)
+{
+    return REGION_SET_FLAG | ((unsigned int)(color.profile & 0x7f) << 24) | ((unsigned int)color.red << 16) | ((unsigned int)color.green << 8) | color.blue;
+}
+
+/**
+ * @brief unpacks a word into a color
+ */
+static struct color unpack_region(unsigned int packed)
+{
+    struct color ret;
+    ret.profile = (enum color_profile)((packed >> 24) & 0x7f);
+    ret.red = (byte)(packed >> 16);
+    ret.green = (byte)(packed >> 8);
+    ret.blue = (byte)packed;
+    return ret;
+}
+
+struct shared_state* shared_state_open()
+{
+    struct shared_state* ret = NULL;
+    int fd = shm_open(SHARED_STATE_NAME, O_RDWR | O_CREAT, 0666);
+    if (fd >= 0)
+    {
+        //the segment is shared between root (flusher) and unprivileged writers, so do not let the umask restrict it
+        fchmod(fd, 0666);
+
+        //growing the segment zero-fills it, so concurrent openers agree on the initial state; the size is checked again as the segment might have been replaced
+        struct stat info;
+        if (fstat(fd, &info) == 0 && (info.st_size >= (off_t)sizeof(struct shared_state) || ftruncate(fd, sizeof(struct shared_state)) == 0) &&
+            fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(struct shared_state))
+        {
+            void* mapping = mmap(NULL, sizeof(struct shared_state), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                ret = (struct shared_state*)mapping;
+                if (ret->magic != SHARED_STATE_MAGIC)
+                    ret->magic = SHARED_STATE_MAGIC;
+            }
+        }
+
+        if (ret != NULL)
+            segment_fd = fd;
+        else
+            close(fd);
+    }
+    return ret;
+}
+
+void shared_state_close(struct shared_state* state)
+{
+    if (state != NULL)
+    {
+        munmap(state, sizeof(struct shared_state));
+        if (segment_fd >= 0)
+            close(segment_fd);
+        segment_fd = -1;
+    }
+}
+
+/**
+ * @brief checks if an odd sequence has not changed for SHARED_STALE_TIME and if so and its writer is dead, closes the update the writer left behind
+ * @param state the shared state
+ * @param word the observed sequence word
+ * @param watch the watch of the caller (zero-initialized before the first call)
+ */
+static void release_if_stale(struct shared_state* state, unsigned long long word, struct stale_watch* watch)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!(word & 1) || !watch->active || watch->sequence != word)
+    {
+        watch->active = (word & 1) != 0;
+        watch->sequence = word;
+        watch->since = now;
+    }
+    else if (timespec_seconds_between(&watch->since, &now) >= SHARED_STALE_TIME)
+    {
+        //a stopped or just slow writer is waited for (and checked again after the next SHARED_STALE_TIME),
+        //the regions a dead writer has already stored are kept, which is as good as any other state
+        if (writer_dead(WRITER_OF(word)))
+        {
+            atomic_compare_exchange_strong_explicit(&state->sequence, &word, sequence_word(SEQUENCE_OF(word) + 1, WRITER_OF(word)),
+                                                    memory_order_acq_rel, memory_order_relaxed);
+            watch->active = false;
+        }
+        else
+        {
+            watch->since = now;
+        }
+    }
+}
+
+/**
+ * @brief checks if the segment still has its full size and if not, grows it again (which zero-fills the lost part)
+ * @returns true if the segment can be read, false if it had to be restored
+ */
+static bool restore_if_truncated(struct shared_state* state)
+{
+    bool ret = true;
+    struct stat info;
+    if (segment_fd >= 0 && (fstat(segment_fd, &info) != 0 || info.st_size < (off_t)sizeof(struct shared_state)))
+    {
+        if (ftruncate(segment_fd, sizeof(struct shared_state)) == 0)
+            state->magic = SHARED_STATE_MAGIC;
+        ret = false;
+    }
+    return ret;
+}
+
+/**
+ * @brief continues after an access to a segment that was truncated while the flusher accessed it
+ *
+ * A bus error outside of guarded_check() is not caused by the segment: the default action is restored, so the faulting access crashes as usual.
+ */
+static void on_bus_error(int signal)
+{
+    if (bus_error_armed)
+        siglongjmp(bus_error_jump, 1);
+    else
+        sigaction(signal, &(struct sigaction){ .sa_handler = SIG_DFL }, NULL);
+}
+
+/**
+ * @brief checks if a packed region can be sent with the given brightness (cf. set_color())
+ */
+static bool valid_region(unsigned int packed, unsigned int brightness)
+{
+    unsigned int profile = (packed >> 24) & 0x7f;
+    return (packed & REGION_SET_FLAG) != 0 && (profile <= white || profile == custom) &&
+           (brightness == rgb || brightness == off || profile != custom);
+}
+
+/**
+ * @brief checks if brightness and mode of a snapshot are valid
+ */
+static bool valid_settings(const struct shared_snapshot* snapshot)
+{
+    return (snapshot->brightness == high || snapshot->brightness == medium || snapshot->brightness == low || snapshot->brightness == off || snapshot->brightness == rgb) &&
+           snapshot->mode >= normal && snapshot->mode <= wave;
+}
+
+void shared_state_publish(struct shared_state* state, const struct color* colors, int num_regions, enum brightness brightness, enum mode mode)
+{
+    //begin: take the sequence from even to odd and record the writer, spinning (in user space) while another writer is active
+    pid_t writer = current_writer();
+    unsigned long long word = atomic_load_explicit(&state->sequence, memory_order_relaxed);
+    struct stale_watch watch = { 0 };
+    unsigned long spins = 0;
+    do
+    {
+        while (word & 1)
+        {
+            if (++spins % SHARED_SPIN_LIMIT == 0)
+            {
+                sched_yield();
+                release_if_stale(state, word, &watch);
+            }
+            word = atomic_load_explicit(&state->sequence, memory_order_relaxed);
+        }
+    }
+    while (!atomic_compare_exchange_weak_explicit(&state->sequence, &word, sequence_word(SEQUENCE_OF(word) + 1, writer), memory_order_acquire, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);
+    unsigned int sequence = SEQUENCE_OF(word);
+
+    for (int i=0; i<num_regions && i<SHARED_MAX_REGIONS; ++i)
+        atomic_store_explicit(&state->regions[i], pack_region(colors[i]), memory_order_relaxed);
+    atomic_store_explicit(&state->brightness, (unsigned int)brightness, memory_order_relaxed);
+    atomic_store_explicit(&state->mode, (unsigned int)mode, memory_order_relaxed);
+
+    //end: publish the new state by making the sequence even again; if the update was released meanwhile, another writer might
+    //own the sequence already, so the update is dropped instead of making its sequence even while it is still writing
+    word = sequence_word(sequence + 1, writer);
+    atomic_compare_exchange_strong_explicit(&state->sequence, &word, sequence_word(sequence + 2, writer), memory_order_release, memory_order_relaxed);
+}
+
+bool shared_state_changed(struct shared_state* state, const struct shared_snapshot* snapshot)
+{
+    return SEQUENCE_OF(atomic_load_explicit(&state->sequence, memory_order_relaxed)) != snapshot->sequence;
+}
+
+int shared_state_snapshot(struct shared_state* state, struct shared_snapshot* snapshot)
+{
+    int ret = -1;
+    unsigned int regions[SHARED_MAX_REGIONS];
+    unsigned int brightness = 0, mode = 0, begin = 0, end;
+    for (int i=0; i<SHARED_SNAPSHOT_TRIES && ret != 0 && !animation_stop_requested(); ++i)
+    {
+        begin = SEQUENCE_OF(atomic_load_explicit(&state->sequence, memory_order_acquire));
+        for (int i=0; i<SHARED_MAX_REGIONS; ++i)
+            regions[i] = atomic_load_explicit(&state->regions[i], memory_order_relaxed);
+        brightness = atomic_load_explicit(&state->brightness, memory_order_relaxed);
+        mode = atomic_load_explicit(&state->mode, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        end = SEQUENCE_OF(atomic_load_explicit(&state->sequence, memory_order_relaxed));
+        if (!(begin & 1) && begin == end)
+            ret = 0;
+    }
+
+    if (ret == 0)
+    {
+        snapshot->sequence = begin;
+        for (int i=0; i<SHARED_MAX_REGIONS; ++i)
+        {
+            snapshot->colors[i] = unpack_region(regions[i]);
+            snapshot->valid[i] = valid_region(regions[i], brightness);
+        }
+        snapshot->brightness = (enum brightness)brightness;
+        snapshot->mode = (enum mode)mode;
+    }
+    return ret;
+}
+
+int shared_state_flush(hid_device* dev, const struct shared_snapshot* snapshot, struct shared_snapshot* flushed)
+{
+    int ret = 0;
+    if (valid_settings(snapshot))
+    {
+        bool resend_all = snapshot->brightness != flushed->brightness || snapshot->mode != flushed->mode;
+        for (int i=0; i<SHARED_MAX_REGIONS && ret >= 0; ++i)
+        {
+            const struct color* color = &snapshot->colors[i];
+            const struct color* previous = &flushed->colors[i];
+            if (snapshot->valid[i] &&
+                (resend_all || !flushed->valid[i] || color->profile != previous->profile || color->red != previous->red || color->green != previous->green || color->blue != previous->blue))
+            {
+                int length = set_color(dev, *color, i+1, snapshot->brightness);
+                if (length > 0)
+                    ++ret;
+                else if (length < 0) //nothing is sent for regions the keyboard does not have
+                    ret = -1;
+            }
+        }
+
+        //commit the colors (or the changed mode)
+        if (ret > 0 || (ret == 0 && resend_all))
+            ret = set_mode(dev, snapshot->mode) > 0 ? ret + 1 : -1;
+
+        if (ret >= 0)
+            *flushed = *snapshot;
+    }
+    else
+    {
+        //any local user can write the segment: keep the flushed state until a valid one is published
+        flushed->sequence = snapshot->sequence;
+    }
+    return ret;
+}
+
+/**
+ * @brief checks the segment for a change and takes a snapshot; every access to the segment fails instead of crashing if it is truncated meanwhile (cf. on_bus_error())
+ * @returns 1 if a snapshot was taken, 0 if nothing changed or a writer is active, -1 if the segment was truncated
+ */
+static int guarded_check(struct shared_state* state, const struct shared_snapshot* flushed, struct shared_snapshot* snapshot, struct stale_watch* watch)
+{
+    volatile int ret = -1;
+    if (sigsetjmp(bus_error_jump, 1) == 0)
+    {
+        bus_error_armed = 1;
+        if (!restore_if_truncated(state))
+        {
+            ret = -1;
+        }
+        else if (!shared_state_changed(state, flushed))
+        {
+            ret = 0;
+        }
+        else if (shared_state_snapshot(state, snapshot) == 0)
+        {
+            ret = 1;
+        }
+        else
+        {
+            //a writer is active: try again at the next check, unless it was killed in the middle of its update
+            release_if_stale(state, atomic_load_explicit(&state->sequence, memory_order_relaxed), watch);
+            ret = 0;
+        }
+    }
+    bus_error_armed = 0;
+    return ret;
+}
+
+int shared_state_run_flusher(hid_device* dev, struct shared_state* state, int fps)
+{
+    int ret = fps > 0 ? 0 : -1;
+    struct shared_snapshot snapshot, flushed;
+    struct stale_watch watch = { 0 };
+    memset(&flushed, 0, sizeof(flushed));
+
+    struct sigaction action, previous;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_bus_error;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &previous);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    animation_catch_signals(true);
+
+    while (ret == 0 && !animation_stop_requested())
+    {
+        if (guarded_check(state, &flushed, &snapshot, &watch) == 1 && shared_state_flush(dev, &snapshot, &flushed) < 0)
+            ret = -1;
+
+        timespec_advance(&deadline, 1000000000L / fps);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+
+    animation_catch_signals(false);
+    sigaction(SIGBUS, &previous, NULL);
+    return ret;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file shared.h
+ *
+ * @brief header file for the shared-memory region state that allows multiple processes to set the keyboard's colors concurrently
+ *
+ * The state lives in a POSIX shared-memory segment (/dev/shm/msiklm) and is protected by a seqlock:
+ * writers take the sequence counter from even to odd with a single compare-and-swap, store the new
+ * values and make it even again, so publishing a state requires neither a syscall nor a lock and
+ * never exposes a half-updated frame. A single flusher process polls the sequence counter, takes
+ * consistent snapshots and sends only the changed regions to the keyboard.
+ *
+ * The segment is writable by every local user, so the flusher trusts none of its contents: it gives
+ * up a snapshot after a bounded number of attempts, releases a sequence that a killed writer left
+ * odd, restores a truncated segment and ignores values that are out of range. The sequence counter
+ * carries the pid of its writer, so a writer that is merely stopped (e.g. by SIGSTOP) is never
+ * released and a writer that was released nevertheless (e.g. one in another pid namespace) drops
+ * its update instead of corrupting the counter.
+ */
+
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "msiklm.h"
+
+#define SHARED_STATE_NAME     "/msiklm"
+#define SHARED_STATE_MAGIC    0x4d534b31 //"MSK1"
+#define SHARED_MAX_REGIONS    7
+#define SHARED_SNAPSHOT_TRIES 1000       //attempts of a snapshot before it is given up while a writer is active
+#define SHARED_SPIN_LIMIT     1000       //spins of a waiting writer before it yields the cpu
+#define SHARED_STALE_TIME     1.0        //seconds after which the writer of an unchanged odd sequence is checked for being dead
+
+/**
+ * @brief shared state struct: the layout of the shared-memory segment
+ *
+ * Each region is packed into a single word (bits 0-23: rgb, bits 24-30: color profile, bit 31: set at least once)
+ * such that all accesses are plain relaxed atomic loads and stores. The sequence word holds the sequence counter
+ * (bits 0-31) and the pid of the writer that incremented it last (bits 32-63), so both are swapped together.
+ */
+struct shared_state
+{
+    uint32_t magic;
+    atomic_ullong sequence;                        //odd while a writer is updating the state, the writer's pid in the upper half
+    atomic_uint regions[SHARED_MAX_REGIONS];
+    atomic_uint brightness;
+    atomic_uint mode;
+};
+
+/**
+ * @brief shared snapshot struct: a consistent copy of the shared state
+ */
+struct shared_snapshot
+{
+    unsigned int sequence;
+    struct color colors[SHARED_MAX_REGIONS];
+    bool valid[SHARED_MAX_REGIONS];                //true if the region has been set by any writer and its color can be sent
+    enum brightness brightness;
+    enum mode mode;
+};
+
+/**
+ * @brief opens (and if required creates) the shared-memory segment and maps it; a process maps at most one segment at a time
+ * @returns the mapped shared state, null on error (e.g. if the segment is too small and cannot be grown)
+ */
+struct shared_state* shared_state_open();
+
+/**
+ * @brief unmaps the shared state (the segment itself persists until it is removed or the system reboots)
+ * @param state the shared state
+ */
+void shared_state_close(struct shared_state* state);
+
+/**
+ * @brief publishes new colors for the first regions as well as brightness and mode; concurrent writers are serialized without syscalls
+ *
+ * A writer that keeps the sequence odd for longer than SHARED_STALE_TIME and whose process does not exist anymore
+ * is considered killed and its update is closed. If this update is closed that way, it is dropped.
+ *
+ * @param state the shared state
+ * @param colors the colors of the regions starting with the left one
+ * @param num_regions the number of colors (at most SHARED_MAX_REGIONS)
+ * @param brightness the brightness
+ * @param mode the mode
+ */
+void shared_state_publish(struct shared_state* state, const struct color* colors, int num_regions, enum brightness brightness, enum mode mode);
+
+/**
+ * @brief checks without taking a snapshot if the state has been changed since the given snapshot
+ * @param state the shared state
+ * @param snapshot the previous snapshot
+ * @returns true if any writer has published since the snapshot was taken
+ */
+bool shared_state_changed(struct shared_state* state, const struct shared_snapshot* snapshot);
+
+/**
+ * @brief takes a consistent snapshot of the shared state; regions with an invalid color are marked as not valid
+ * @param state the shared state
+ * @param snapshot the snapshot
+ * @returns 0 on success, -1 if a writer was active during SHARED_SNAPSHOT_TRIES attempts or SIGINT / SIGTERM was received
+ */
+int shared_state_snapshot(struct shared_state* state, struct shared_snapshot* snapshot);
+
+/**
+ * @brief sends the difference between two snapshots to the keyboard: only changed regions, all of them if brightness or mode changed
+ *
+ * A snapshot with an invalid brightness or mode is not sent but marked as flushed, such that it is not retried.
+ *
+ * @param dev the hid device
+ * @param snapshot the current snapshot
+ * @param flushed the previously flushed snapshot (zero-initialized if nothing has been flushed yet); it is updated on success
+ * @returns the number of sent reports, -1 on error
+ */
+int shared_state_flush(hid_device* dev, const struct shared_snapshot* snapshot, struct shared_snapshot* flushed);
+
+/**
+ * @brief runs the flusher: checks the shared state at the given rate and flushes every change until SIGINT / SIGTERM
+ *
+ * A segment that was truncated is grown again (a concurrent truncation during any access to it is caught), so no writer can crash the flusher.
+ *
+ * @param dev the hid device
+ * @param state the shared state
+ * @param fps the rate at which the state is checked (a check is a size check of the segment and a single atomic load if nothing changed)
+ * @returns 0 if the flusher was interrupted, -1 on error
+ */
+int shared_state_run_flusher(hid_device* dev, struct shared_state* state, int fps);
+
+#endif //SHARED_H
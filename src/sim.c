@@ -0,0 +1,311 @@
+/**
+ * @file sim.c
+ *
+ * @brief source file that contains the simulated keyboard
+ */
+
+#include "sim.h"
+#include "animation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_DEFAULT_LATENCY 1000 //microseconds
+#define SIM_DEFAULT_RATE    250  //reports per second
+#define SIM_KEY_REPORT_ID   0x0e //per-key protocol: {0x0e, 0, count (little endian), count * {key, red, green, blue}, zero padding}
+#define SIM_KEY_REPORT_SIZE 524
+#define SIM_KEY_MAX_COUNT   130
+#define SIM_APPLY_REPORT_ID 0x0d //per-key protocol: applies the sent key colors
+#define SIM_APPLY_SIZE      64
+
+/**
+ * @brief simulated keyboard struct: settings, virtual state and statistics
+ */
+struct sim_device
+{
+    bool initialized;
+    long latency_ns;
+    long interval_ns;                              //minimal time between two reports, 0 for unlimited
+    bool preview;
+    struct timespec ready;                         //point in time when the device accepts the next report
+    struct color committed[SIM_NUM_REGIONS];
+    struct color pending[SIM_NUM_REGIONS];
+    bool pending_valid[SIM_NUM_REGIONS];
+    struct color committed_keys[SIM_NUM_KEYS];
+    struct color pending_keys[SIM_NUM_KEYS];
+    bool pending_keys_valid[SIM_NUM_KEYS];
+    enum mode mode;
+    struct sim_stats stats;
+};
+
+static struct sim_device sim;
+
+/**
+ * @brief the rgb values of the predefined colors (indexed by their profile, cf. parse_color())
+ */
+static const byte profile_colors[white + 1][3] =
+{
+    {   0,   0,   0 }, //none
+    { 255,   0,   0 }, //red
+    { 255, 100,   0 }, //orange
+    { 255, 255,   0 }, //yellow
+    {   0, 255,   0 }, //green
+    {   0, 255, 255 }, //sky
+    {   0,   0, 255 }, //blue
+    { 255,   0, 255 }, //purple
+    { 255, 255, 255 }  //white
+};
+
+/**
+ * @brief the names of the modes for the preview (indexed by the mode)
+ */
+static const char* mode_names[wave + 1] = { "", "normal", "gaming", "breathe", "demo", "wave" };
+
+/**
+ * @brief parses the settings (cf. SIM_ENV)
+ * @returns 0 on success, -1 if any setting is invalid
+ */
+static int parse_settings(const char* settings)
+{
+    int ret = 0;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", settings);
+
+    char* save_ptr = NULL;
+    for (char* setting = strtok_r(buffer, ",", &save_ptr); setting != NULL && ret == 0; setting = strtok_r(NULL, ",", &save_ptr))
+    {
+        char* end_ptr = NULL;
+        if (strncmp(setting, "latency=", 8) == 0)
+        {
+            long latency = strtol(setting + 8, &end_ptr, 10);
+            if (end_ptr != setting + 8 && *end_ptr == '\0' && latency >= 0 && latency <= 1000000)
+                sim.latency_ns = latency * 1000;
+            else
+                ret = -1;
+        }
+        else if (strncmp(setting, "rate=", 5) == 0)
+        {
+            long rate = strtol(setting + 5, &end_ptr, 10);
+            if (end_ptr != setting + 5 && *end_ptr == '\0' && rate >= 0 && rate <= 1000000)
+                sim.interval_ns = rate > 0 ? 1000000000L / rate : 0;
+            else
+                ret = -1;
+        }
+        else if (strcmp(setting, "preview") == 0)
+        {
+            sim.preview = true;
+        }
+        else if (strcmp(setting, "1") != 0) //MSIKLM_SIM=1 just selects the defaults
+        {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief renders the committed state as a single terminal line
+ */
+static void render_preview()
+{
+    printf("\r");
+    for (int i=0; i<SIM_NUM_REGIONS; ++i)
+        printf("\033[48;2;%d;%d;%dm    \033[0m ", sim.committed[i].red, sim.committed[i].green, sim.committed[i].blue);
+    printf("%-8s", mode_names[sim.mode]);
+    fflush(stdout);
+}
+
+/**
+ * @brief prints the statistics when the process exits
+ */
+static void print_stats()
+{
+    if (sim.preview)
+        printf("\n");
+    printf("sim: %lu reports received, %lu rejected, %lu coalesced, %lu commits, %lu throttled, %lu key reports\n",
+           sim.stats.received, sim.stats.rejected, sim.stats.coalesced, sim.stats.commits, sim.stats.throttled, sim.stats.key_reports);
+}
+
+/**
+ * @brief applies the latency and rate model: blocks until the device accepts the report and the transfer is finished
+ */
+static void simulate_transfer()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (timespec_seconds_between(&now, &sim.ready) > 0)
+    {
+        ++sim.stats.throttled;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sim.ready, NULL);
+        now = sim.ready;
+    }
+
+    struct timespec done = now;
+    timespec_advance(&done, sim.latency_ns);
+    sim.ready = now;
+    timespec_advance(&sim.ready, sim.interval_ns);
+    if (sim.latency_ns > 0)
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &done, NULL);
+}
+
+/**
+ * @brief decodes a report of the per-key protocol (a key report or the apply report) into the virtual per-key state
+ * @returns 0 if the report is valid, -1 otherwise
+ */
+static int decode_key_report(const byte* report, size_t length)
+{
+    int ret = -1;
+    if (length == SIM_KEY_REPORT_SIZE && report[0] == SIM_KEY_REPORT_ID)
+    {
+        int count = report[2] | (report[3] << 8);
+        if (report[1] == 0 && count <= SIM_KEY_MAX_COUNT)
+        {
+            //like region colors, key colors are only visible once they are applied
+            for (const byte* entry = &report[4]; entry < &report[4 + 4 * count]; entry += 4)
+            {
+                sim.pending_keys[entry[0]] = (struct color){ custom, entry[1], entry[2], entry[3] };
+                sim.pending_keys_valid[entry[0]] = true;
+            }
+            ++sim.stats.key_reports;
+            ret = 0;
+        }
+    }
+    else if (length == SIM_APPLY_SIZE && report[0] == SIM_APPLY_REPORT_ID)
+    {
+        for (int i=0; i<SIM_NUM_KEYS; ++i)
+        {
+            if (sim.pending_keys_valid[i])
+                sim.committed_keys[i] = sim.pending_keys[i];
+            sim.pending_keys_valid[i] = false;
+        }
+        ++sim.stats.commits;
+        ret = 0;
+    }
+    return ret;
+}
+
+/**
+ * @brief decodes a report of the region protocol into the virtual state
+ * @returns 0 if the report is valid, -1 otherwise
+ */
+static int decode_report(const byte* report, size_t length)
+{
+    int ret = -1;
+    if (length == 8 && report[0] == 1 && report[1] == 2 && report[7] == 236)
+    {
+        int region = report[3] - 1;
+        if ((report[2] == 64 || report[2] == 66) && region >= 0 && region < SIM_NUM_REGIONS)
+        {
+            struct color color;
+            color.profile = custom;
+            if (report[2] == 64) //rgb
+            {
+                color.red = report[4];
+                color.green = report[5];
+                color.blue = report[6];
+                ret = 0;
+            }
+            else if (report[4] <= white && report[5] <= off) //set: predefined color with explicit brightness
+            {
+                int scale = 3 - report[5];
+                color.red = (byte)(profile_colors[report[4]][0] * scale / 3);
+                color.green = (byte)(profile_colors[report[4]][1] * scale / 3);
+                color.blue = (byte)(profile_colors[report[4]][2] * scale / 3);
+                ret = 0;
+            }
+
+            if (ret == 0)
+            {
+                //a color that was not committed yet is never visible
+                if (sim.pending_valid[region])
+                    ++sim.stats.coalesced;
+                sim.pending[region] = color;
+                sim.pending_valid[region] = true;
+            }
+        }
+        else if (report[2] == 65 && report[3] >= normal && report[3] <= wave) //commit
+        {
+            for (int i=0; i<SIM_NUM_REGIONS; ++i)
+            {
+                if (sim.pending_valid[i])
+                    sim.committed[i] = sim.pending[i];
+                sim.pending_valid[i] = false;
+            }
+            sim.mode = (enum mode)report[3];
+            ++sim.stats.commits;
+            if (sim.preview)
+                render_preview();
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+bool sim_enabled()
+{
+    return getenv(SIM_ENV) != NULL;
+}
+
+hid_device* sim_open()
+{
+    hid_device* ret = (hid_device*)&sim;
+    if (!sim.initialized)
+    {
+        memset(&sim, 0, sizeof(sim));
+        sim.latency_ns = SIM_DEFAULT_LATENCY * 1000L;
+        sim.interval_ns = 1000000000L / SIM_DEFAULT_RATE;
+        sim.mode = normal;
+        for (int i=0; i<SIM_NUM_REGIONS; ++i)
+            sim.committed[i].profile = custom;
+        for (int i=0; i<SIM_NUM_KEYS; ++i)
+            sim.committed_keys[i].profile = custom;
+        clock_gettime(CLOCK_MONOTONIC, &sim.ready);
+
+        const char* settings = getenv(SIM_ENV);
+        if (parse_settings(settings != NULL ? settings : "") == 0)
+        {
+            sim.initialized = true;
+            atexit(print_stats);
+        }
+        else
+        {
+            printf("Invalid %s settings '%s' - expected a comma-separated list of latency=<us>, rate=<n> and preview\n", SIM_ENV, settings);
+            ret = NULL;
+        }
+    }
+    return ret;
+}
+
+bool sim_is_device(const hid_device* dev)
+{
+    return dev == (const hid_device*)&sim;
+}
+
+int sim_send_report(const byte* report, size_t length)
+{
+    ++sim.stats.received;
+    simulate_transfer();
+
+    int decoded = length == 8 ? decode_report(report, length) : decode_key_report(report, length);
+    int ret = decoded == 0 ? (int)length : -1;
+    if (ret < 0)
+        ++sim.stats.rejected;
+    return ret;
+}
+
+void sim_get_state(struct color* colors, enum mode* mode)
+{
+    memcpy(colors, sim.committed, sizeof(sim.committed));
+    *mode = sim.mode;
+}
+
+void sim_get_keys(struct color* colors)
+{
+    memcpy(colors, sim.committed_keys, sizeof(sim.committed_keys));
+}
+
+const struct sim_stats* sim_get_stats()
+{
+    return &sim.stats;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file sim.h
+ *
+ * @brief header file for the simulated keyboard that replaces the hid device at runtime
+ *
+ * The simulation is selected by the environment variable MSIKLM_SIM which contains a comma-separated
+ * list of settings (an empty value uses the defaults):
+ *
+ *  - latency=<us>   time each feature report blocks the caller in microseconds (default: 1000)
+ *  - rate=<n>       maximal number of reports per second, faster reports wait for the device (default: 250, 0 for unlimited)
+ *  - preview        renders the committed state of all regions as a live ANSI preview on the terminal
+ *
+ * The simulated keyboard decodes the reports of the region protocol (the set, rgb and commit
+ * commands) into a virtual 7-region state and the reports of the per-key protocol (the key and apply
+ * reports) into a virtual per-key state, so no hardware and no root privileges are required. The
+ * statistics are printed when the process exits. The state is not persisted, every process starts
+ * with a dark keyboard, so a fade from the colors of a previous invocation cannot be simulated.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include "msiklm.h"
+
+#define SIM_ENV         "MSIKLM_SIM"
+#define SIM_NUM_REGIONS 7
+#define SIM_NUM_KEYS    256 //one per HID usage ID
+
+/**
+ * @brief simulation statistics struct: what the simulated keyboard received
+ */
+struct sim_stats
+{
+    unsigned long received;        //all feature reports
+    unsigned long rejected;        //malformed reports or invalid values
+    unsigned long coalesced;       //color reports that were overwritten before they were committed
+    unsigned long commits;         //commit (mode) and apply reports
+    unsigned long key_reports;     //per-key color reports
+    unsigned long throttled;       //reports that had to wait because they exceeded the rate
+};
+
+/**
+ * @brief checks if the simulated keyboard is selected (cf. SIM_ENV)
+ * @returns true if the simulated keyboard should be used instead of a hid device
+ */
+bool sim_enabled();
+
+/**
+ * @brief opens the simulated keyboard; its state is kept when it is closed and reopened
+ * @returns the simulated keyboard, null if the settings in SIM_ENV are invalid
+ */
+hid_device* sim_open();
+
+/**
+ * @brief checks if a device is the simulated keyboard
+ * @param dev the device
+ * @returns true if dev was returned by sim_open()
+ */
+bool sim_is_device(const hid_device* dev);
+
+/**
+ * @brief sends a feature report to the simulated keyboard (applying the latency and rate model)
+ * @param report the report
+ * @param length the report's length
+ * @returns the number of accepted bytes, -1 if the report was rejected
+ */
+int sim_send_report(const byte* report, size_t length);
+
+/**
+ * @brief returns the committed state of the simulated keyboard
+ * @param colors the rgb values of all SIM_NUM_REGIONS regions (with brightness applied)
+ * @param mode the committed mode
+ */
+void sim_get_state(struct color* colors, enum mode* mode);
+
+/**
+ * @brief returns the committed per-key state of the simulated keyboard
+ * @param colors the rgb values of all SIM_NUM_KEYS keys (indexed by their HID usage ID)
+ */
+void sim_get_keys(struct color* colors);
+
+/**
+ * @brief returns the statistics of the simulated keyboard
+ * @returns the statistics
+ */
+const struct sim_stats* sim_get_stats();
+
+#endif //SIM_H
@@ -0,0 +1,577 @@
+/**
+ * @file timeline.c
+ *
+ * @brief source file that contains the timeline compiler and player
+ */
+
+#include "timeline.h"
+#include "animation.h"
+#include "protocol.h"
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief task queue struct: the chunks of a worker; the owner takes them from the front, thieves from the back
+ */
+struct task_queue
+{
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+};
+
+/**
+ * @brief thread pool struct: a work-stealing pool that runs a task for each chunk
+ */
+struct thread_pool
+{
+    int num_workers;
+    struct task_queue* queues;
+    void (*task)(void* context, int chunk);
+    void* context;
+};
+
+/**
+ * @brief worker struct: a worker thread of the pool
+ */
+struct worker
+{
+    struct thread_pool* pool;
+    int index;
+    pthread_t thread;
+    bool started;
+    unsigned long steals;
+};
+
+/**
+ * @brief compile context struct: the shared state of all compile tasks
+ */
+struct compile_context
+{
+    const struct timeline_script* script;
+    const struct protocol* protocol;
+    int fps;
+    int num_regions;
+    byte region_mask;                          //regions the protocol has (one bit per region)
+    uint32_t report_size;
+    uint32_t num_frames;
+    uint32_t* segment_starts;                  //first frame of each segment (plus the total number of frames)
+    byte* planes;                              //rendered channels: [channel][region][frame]
+    byte* masks;                               //changed regions of each frame (one bit per region)
+    uint32_t* chunk_deltas;                    //number of deltas of each chunk, afterwards the index of each chunk's first delta
+    uint32_t* offsets;                         //the file's arrays (cf. timeline.h)
+    byte* regions;
+    byte* reports;
+};
+
+/**
+ * @brief takes a chunk from the front (owner) or the back (thief) of a queue
+ * @returns the chunk, -1 if the queue is empty
+ */
+static int take_task(struct task_queue* queue, bool front)
+{
+    int ret = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+        ret = front ? queue->head++ : --queue->tail;
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
+
+/**
+ * @brief the worker loop: processes its own chunks in order and steals from the other workers once they are done
+ */
+static void* run_worker(void* argument)
+{
+    struct worker* worker = (struct worker*)argument;
+    struct thread_pool* pool = worker->pool;
+    for (;;)
+    {
+        int chunk = take_task(&pool->queues[worker->index], true);
+        for (int i=1; i<pool->num_workers && chunk < 0; ++i)
+        {
+            chunk = take_task(&pool->queues[(worker->index + i) % pool->num_workers], false);
+            if (chunk >= 0)
+                ++worker->steals;
+        }
+
+        //no chunks are added while the pool runs, so all queues being empty means that the work is done
+        if (chunk < 0)
+            break;
+        pool->task(pool->context, chunk);
+    }
+    return NULL;
+}
+
+/**
+ * @brief runs a task for all chunks on a work-stealing pool; each worker starts with a contiguous range of chunks
+ * @returns the number of stolen chunks, -1 on error
+ */
+static long run_pool(int num_workers, int num_chunks, void (*task)(void* context, int chunk), void* context)
+{
+    long ret = -1;
+    struct thread_pool pool = { num_workers, NULL, task, context };
+    struct worker* workers = (struct worker*)calloc(num_workers, sizeof(struct worker));
+    pool.queues = (struct task_queue*)calloc(num_workers, sizeof(struct task_queue));
+    if (workers != NULL && pool.queues != NULL)
+    {
+        for (int i=0; i<num_workers; ++i)
+        {
+            pthread_mutex_init(&pool.queues[i].lock, NULL);
+            pool.queues[i].head = (int)((long)num_chunks * i / num_workers);
+            pool.queues[i].tail = (int)((long)num_chunks * (i + 1) / num_workers);
+            workers[i].pool = &pool;
+            workers[i].index = i;
+        }
+
+        //the calling thread is the first worker; the chunks of workers that could not be started are stolen by the others
+        for (int i=1; i<num_workers; ++i)
+            workers[i].started = pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) == 0;
+        run_worker(&workers[0]);
+
+        ret = (long)workers[0].steals;
+        for (int i=1; i<num_workers; ++i)
+        {
+            if (workers[i].started)
+                pthread_join(workers[i].thread, NULL);
+            ret += (long)workers[i].steals;
+        }
+        for (int i=0; i<num_workers; ++i)
+            pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+    free(pool.queues);
+    free(workers);
+    return ret;
+}
+
+/**
+ * @brief returns the plane of a channel (0: red, 1: green, 2: blue) of a region
+ */
+static byte* plane(const struct compile_context* context, int channel, int region)
+{
+    return context->planes + ((size_t)channel * context->num_regions + region) * context->num_frames;
+}
+
+/**
+ * @brief compile task 1: renders the frames of a chunk into the planes
+ */
+static void render_chunk(void* argument, int chunk)
+{
+    const struct compile_context* context = (const struct compile_context*)argument;
+    uint32_t begin = (uint32_t)chunk * TIMELINE_CHUNK_FRAMES;
+    uint32_t end = begin + TIMELINE_CHUNK_FRAMES < context->num_frames ? begin + TIMELINE_CHUNK_FRAMES : context->num_frames;
+
+    byte* planes[3][TIMELINE_MAX_REGIONS];
+    for (int c=0; c<3; ++c)
+        for (int r=0; r<context->num_regions; ++r)
+            planes[c][r] = plane(context, c, r);
+
+    int segment = 0;
+    struct color frame[TIMELINE_MAX_REGIONS];
+    for (uint32_t f=begin; f<end; ++f)
+    {
+        while (context->segment_starts[segment + 1] <= f)
+            ++segment;
+
+        const struct timeline_segment* current = &context->script->segments[segment];
+        if (current->is_effect)
+            effect_render_at(&current->effect, frame, context->num_regions, (double)(f - context->segment_starts[segment]) / context->fps);
+        else
+            memcpy(frame, current->colors, context->num_regions * sizeof(struct color));
+
+        for (int r=0; r<context->num_regions; ++r)
+        {
+            planes[0][r][f] = frame[r].red;
+            planes[1][r][f] = frame[r].green;
+            planes[2][r][f] = frame[r].blue;
+        }
+    }
+}
+
+/**
+ * @brief compile task 2: determines the regions that changed in each frame of a chunk (the first frame sets all regions)
+ */
+static void diff_chunk(void* argument, int chunk)
+{
+    const struct compile_context* context = (const struct compile_context*)argument;
+    uint32_t begin = (uint32_t)chunk * TIMELINE_CHUNK_FRAMES;
+    uint32_t end = begin + TIMELINE_CHUNK_FRAMES < context->num_frames ? begin + TIMELINE_CHUNK_FRAMES : context->num_frames;
+
+    memset(&context->masks[begin], 0, end - begin);
+    for (int c=0; c<3; ++c)
+    {
+        for (int r=0; r<context->num_regions; ++r)
+        {
+            //each plane is scanned sequentially, which keeps the comparison cache-friendly
+            const byte* values = plane(context, c, r);
+            for (uint32_t f=begin; f<end; ++f)
+                if (f == 0 || values[f] != values[f-1])
+                    context->masks[f] |= (byte)(1 << r);
+        }
+    }
+
+    //regions the protocol does not have are never sent
+    uint32_t deltas = 0;
+    for (uint32_t f=begin; f<end; ++f)
+    {
+        context->masks[f] &= context->region_mask;
+        deltas += (uint32_t)__builtin_popcount(context->masks[f]);
+    }
+    context->chunk_deltas[chunk] = deltas;
+}
+
+/**
+ * @brief compile task 3: encodes the deltas of a chunk into the file
+ */
+static void encode_chunk(void* argument, int chunk)
+{
+    const struct compile_context* context = (const struct compile_context*)argument;
+    uint32_t begin = (uint32_t)chunk * TIMELINE_CHUNK_FRAMES;
+    uint32_t end = begin + TIMELINE_CHUNK_FRAMES < context->num_frames ? begin + TIMELINE_CHUNK_FRAMES : context->num_frames;
+
+    byte buffer[PROTOCOL_MAX_REPORT_SIZE];
+    uint32_t index = context->chunk_deltas[chunk];
+    for (uint32_t f=begin; f<end; ++f)
+    {
+        context->offsets[f] = index;
+        for (int r=0; r<context->num_regions; ++r)
+        {
+            if (context->masks[f] & (1 << r))
+            {
+                struct color color = { custom, plane(context, 0, r)[f], plane(context, 1, r)[f], plane(context, 2, r)[f] };
+                context->protocol->encode_color(buffer, color, r+1, rgb);
+                memcpy(&context->reports[(size_t)index * context->report_size], buffer, context->report_size);
+                context->regions[index++] = (byte)(r+1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief rounds a file position up to the next multiple of 8
+ */
+static uint64_t align_position(uint64_t position)
+{
+    return (position + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief parses a segment line
+ * @returns 0 on success, -1 if the line is invalid
+ */
+static int parse_segment(struct timeline_segment* segment, const char* line, int num_regions)
+{
+    int ret = -1;
+    char first[256];
+    char second[256];
+    char period_str[32];
+    char rest[2];
+    int fields = sscanf(line, "%lf %255s %255s %31s %1s", &segment->duration, first, second, period_str, rest);
+
+    enum effect_type type = fields >= 2 ? parse_effect(first) : (enum effect_type)-1;
+    if (fields >= 2 && fields <= 4 && segment->duration > 0 && segment->duration <= 86400)
+    {
+        if ((int)type >= 0)
+        {
+            struct color stops[EFFECT_MAX_STOPS];
+            int num_stops = 0;
+            double period = 2;
+            char* end_ptr = NULL;
+            if ((fields < 3 || parse_color_list(second, stops, EFFECT_MAX_STOPS, &num_stops) == 0) &&
+                (fields < 4 || ((period = strtod(period_str, &end_ptr)) > 0 && *end_ptr == '\0')))
+            {
+                segment->is_effect = true;
+                ret = effect_init(&segment->effect, type, stops, num_stops, period, 1, -1, num_regions);
+            }
+        }
+        else if (fields == 2)
+        {
+            struct color colors[TIMELINE_MAX_REGIONS];
+            int num_colors = 0;
+            if (parse_color_list(first, colors, TIMELINE_MAX_REGIONS, &num_colors) == 0 && num_colors > 0)
+            {
+                //one color is used for all regions, the regions without a color are off
+                segment->is_effect = false;
+                for (int i=0; i<num_regions; ++i)
+                {
+                    segment->colors[i] = num_colors == 1 ? colors[0] : i < num_colors ? colors[i] : (struct color){ custom, 0, 0, 0 };
+                    segment->colors[i].profile = custom;
+                }
+                ret = 0;
+            }
+        }
+    }
+    return ret;
+}
+
+int timeline_load(struct timeline_script* script, const char* path, int num_regions)
+{
+    int ret = -1;
+    FILE* file = num_regions > 0 && num_regions <= TIMELINE_MAX_REGIONS ? fopen(path, "r") : NULL;
+    if (file != NULL)
+    {
+        char line[1024];
+        int line_number = 0;
+        script->num_regions = num_regions;
+        script->num_segments = 0;
+        ret = 0;
+
+        while (ret == 0 && fgets(line, sizeof(line), file) != NULL)
+        {
+            ++line_number;
+            line[strcspn(line, "\r\n")] = '\0';
+            const char* content = line + strspn(line, " \t");
+            if (content[0] == '\0' || content[0] == '#')
+                continue;
+
+            if (script->num_segments < TIMELINE_MAX_SEGMENTS && parse_segment(&script->segments[script->num_segments], content, num_regions) == 0)
+                ++script->num_segments;
+            else
+                ret = line_number;
+        }
+        fclose(file);
+
+        if (ret == 0 && script->num_segments == 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+int timeline_compile(const struct timeline_script* script, const struct protocol* protocol, int fps, int num_threads, const char* path, struct timeline_stats* stats)
+{
+    int ret = -1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct compile_context context;
+    memset(&context, 0, sizeof(context));
+    context.script = script;
+    context.protocol = protocol;
+    context.fps = fps;
+    context.num_regions = script->num_regions;
+
+    //all reports of a file have the same size: a sample report of each region determines whether the protocol has it and the size of its reports
+    struct timeline_header header;
+    memset(&header, 0, sizeof(header));
+    byte buffer[PROTOCOL_MAX_REPORT_SIZE];
+    bool encodable = true;
+    for (int r=0; r<context.num_regions && encodable; ++r)
+    {
+        int length = protocol->encode_color(buffer, (struct color){ custom, 0, 0, 0 }, r+1, rgb);
+        if (length > 0 && (context.report_size == 0 || (uint32_t)length == context.report_size))
+        {
+            context.report_size = (uint32_t)length;
+            context.region_mask |= (byte)(1 << r);
+        }
+        else if (length != 0)
+        {
+            encodable = false;
+        }
+    }
+    int commit_size = protocol->encode_mode(buffer, normal);
+    if (commit_size > 0 && commit_size <= TIMELINE_COMMIT_SIZE)
+        memcpy(header.commit, buffer, commit_size);
+    else
+        encodable = false;
+
+    //the segment boundaries are rounded from the accumulated durations, so rounding errors do not add up
+    context.segment_starts = (uint32_t*)malloc((script->num_segments + 1) * sizeof(uint32_t));
+    double total = 0;
+    for (int i=0; context.segment_starts != NULL && i<=script->num_segments; ++i)
+    {
+        double frames = round(total * fps);
+        context.segment_starts[i] = frames <= TIMELINE_MAX_FRAMES ? (uint32_t)frames : TIMELINE_MAX_FRAMES + 1;
+        if (i < script->num_segments)
+            total += script->segments[i].duration;
+    }
+    context.num_frames = context.segment_starts != NULL ? context.segment_starts[script->num_segments] : 0;
+
+    int num_chunks = (int)((context.num_frames + TIMELINE_CHUNK_FRAMES - 1) / TIMELINE_CHUNK_FRAMES);
+    if (encodable && context.report_size > 0 && context.num_frames > 0 && context.num_frames <= TIMELINE_MAX_FRAMES && fps > 0 && num_threads > 0)
+    {
+        context.planes = (byte*)malloc((size_t)3 * context.num_regions * context.num_frames);
+        context.masks = (byte*)malloc(context.num_frames);
+        context.chunk_deltas = (uint32_t*)malloc(num_chunks * sizeof(uint32_t));
+    }
+
+    long steals = 0;
+    long diff_steals = 0;
+    if (context.planes != NULL && context.masks != NULL && context.chunk_deltas != NULL &&
+        (steals = run_pool(num_threads, num_chunks, render_chunk, &context)) >= 0 &&
+        (diff_steals = run_pool(num_threads, num_chunks, diff_chunk, &context)) >= 0)
+    {
+        //the index of each chunk's first delta is the prefix sum of the deltas of the previous chunks
+        uint32_t num_deltas = 0;
+        for (int i=0; i<num_chunks; ++i)
+        {
+            uint32_t deltas = context.chunk_deltas[i];
+            context.chunk_deltas[i] = num_deltas;
+            num_deltas += deltas;
+        }
+
+        memcpy(header.magic, TIMELINE_MAGIC, sizeof(header.magic));
+        header.version = TIMELINE_VERSION;
+        header.fps = (uint32_t)fps;
+        header.num_regions = (uint32_t)context.num_regions;
+        header.num_frames = context.num_frames;
+        header.num_deltas = num_deltas;
+        header.report_size = context.report_size;
+        snprintf(header.protocol, sizeof(header.protocol), "%s", protocol->name);
+        header.commit_size = (uint32_t)commit_size;
+        header.offsets_position = align_position(sizeof(header));
+        header.regions_position = align_position(header.offsets_position + ((uint64_t)context.num_frames + 1) * sizeof(uint32_t));
+        header.reports_position = align_position(header.regions_position + num_deltas);
+        uint64_t size = header.reports_position + (uint64_t)num_deltas * context.report_size;
+
+        //the deltas are encoded directly into the mapped file
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            byte* data = ftruncate(fd, (off_t)size) == 0 ? (byte*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : (byte*)MAP_FAILED;
+            if (data != (byte*)MAP_FAILED)
+            {
+                memcpy(data, &header, sizeof(header));
+                context.offsets = (uint32_t*)(data + header.offsets_position);
+                context.regions = data + header.regions_position;
+                context.reports = data + header.reports_position;
+
+                long encode_steals = run_pool(num_threads, num_chunks, encode_chunk, &context);
+                if (encode_steals >= 0)
+                {
+                    context.offsets[context.num_frames] = num_deltas;
+                    steals += diff_steals + encode_steals;
+                    ret = 0;
+                }
+                if (munmap(data, size) != 0)
+                    ret = -1;
+            }
+            close(fd);
+        }
+
+        if (stats != NULL)
+        {
+            stats->deltas = num_deltas;
+            stats->size = size;
+        }
+    }
+
+    free(context.chunk_deltas);
+    free(context.masks);
+    free(context.planes);
+    free(context.segment_starts);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (stats != NULL)
+    {
+        stats->threads = num_threads;
+        stats->frames = context.num_frames;
+        stats->steals = (unsigned long)steals;
+        stats->seconds = timespec_seconds_between(&start, &end);
+    }
+    return ret;
+}
+
+int timeline_play(hid_device* dev, const char* path, bool loop)
+{
+    int ret = -1;
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if (fd >= 0 && fstat(fd, &file_stat) == 0 && (size_t)file_stat.st_size >= sizeof(struct timeline_header))
+    {
+        size_t size = (size_t)file_stat.st_size;
+        const byte* data = (const byte*)mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (data != (const byte*)MAP_FAILED)
+        {
+            const struct timeline_header* header = (const struct timeline_header*)data;
+            const struct protocol* protocol = keyboard_protocol(dev);
+            //all sizes and positions are checked before anything is read from the arrays (the positions first, such that the sums cannot overflow)
+            if (memcmp(header->magic, TIMELINE_MAGIC, sizeof(header->magic)) == 0 && header->version == TIMELINE_VERSION &&
+                header->fps > 0 && header->num_frames > 0 && header->num_frames <= TIMELINE_MAX_FRAMES &&
+                header->report_size > 0 && header->report_size <= PROTOCOL_MAX_REPORT_SIZE &&
+                header->commit_size > 0 && header->commit_size <= sizeof(header->commit) &&
+                header->offsets_position <= size && header->regions_position <= size && header->reports_position <= size &&
+                header->offsets_position % sizeof(uint32_t) == 0 &&
+                header->offsets_position + ((uint64_t)header->num_frames + 1) * sizeof(uint32_t) <= size &&
+                header->regions_position + header->num_deltas <= size &&
+                header->reports_position + (uint64_t)header->num_deltas * header->report_size <= size)
+            {
+                if (strncmp(header->protocol, protocol->name, sizeof(header->protocol)) == 0)
+                    ret = 0;
+                else
+                    printf("The timeline is encoded for the %.32s protocol, but the keyboard uses the %s protocol\n", header->protocol, protocol->name);
+            }
+            else
+            {
+                printf("'%s' is no valid timeline\n", path);
+            }
+
+            const uint32_t* offsets = (const uint32_t*)(data + header->offsets_position);
+            const byte* reports = data + header->reports_position;
+            long interval = 1000000000L / header->fps;
+            unsigned long frames = 0, reports_sent = 0;
+            struct timespec deadline, now, cpu_start, cpu_end, wall_start;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+            clock_gettime(CLOCK_MONOTONIC, &wall_start);
+            deadline = wall_start;
+
+            bool playing = ret == 0;
+            if (playing)
+                animation_catch_signals(true);
+            while (ret == 0 && !animation_stop_requested())
+            {
+                for (uint32_t f=0; f<header->num_frames && ret == 0 && !animation_stop_requested(); ++f)
+                {
+                    //playback only sends what the compiler prepared: the frame's deltas and the commit if there are any
+                    uint32_t first = offsets[f], last = offsets[f+1];
+                    if (last < first || last > header->num_deltas)
+                        ret = -1;
+                    for (uint32_t i=first; i<last && ret == 0; ++i)
+                        ret = send_report(dev, &reports[(size_t)i * header->report_size], header->report_size) > 0 ? 0 : -1;
+                    if (ret == 0 && last > first)
+                        ret = send_report(dev, header->commit, header->commit_size) > 0 ? 0 : -1;
+                    reports_sent += last - first + (last > first ? 1 : 0);
+                    ++frames;
+
+                    //frames that are already late are not queued, the timeline continues from now on
+                    timespec_advance(&deadline, interval);
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if (timespec_seconds_between(&now, &deadline) < 0)
+                        deadline = now;
+                    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+                }
+                if (!loop)
+                    break;
+            }
+
+            if (playing)
+            {
+                animation_catch_signals(false);
+                clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                printf("play: %lu frames, %lu reports, %.2f%% CPU\n", frames, reports_sent,
+                       100 * timespec_seconds_between(&cpu_start, &cpu_end) / timespec_seconds_between(&wall_start, &now));
+            }
+            munmap((void*)data, size);
+        }
+    }
+    else if (fd < 0)
+    {
+        printf("Timeline '%s' could not be opened\n", path);
+    }
+    else
+    {
+        printf("'%s' is no valid timeline\n", path);
+    }
+
+    if (fd >= 0)
+        close(fd);
+    return ret;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file timeline.h
+ *
+ * @brief header file for the timeline compiler that pre-renders long light shows into a file for computation-free playback
+ *
+ * A timeline script contains one segment per line in the format
+ *
+ *     <seconds> <effect> [<colors>] [<period>]    or    <seconds> <colors>
+ *
+ * where the effect and its gradient use the same notation as the effect command and a static segment
+ * shows the given colors (one color is used for all regions, missing regions are off). Empty lines
+ * and lines starting with '#' are ignored; the segments are played one after another.
+ *
+ * The compiler renders all frames in parallel on a work-stealing thread pool into per-channel planes
+ * (structure of arrays), determines which regions changed between consecutive frames and encodes
+ * only these deltas as ready-to-send reports into a memory-mapped file. The file consists of the
+ * header followed by three arrays:
+ *
+ *  - offsets[num_frames + 1]:       index of the first delta of each frame (uint32_t)
+ *  - regions[num_deltas]:           the region of each delta
+ *  - reports[num_deltas][report_size]: the encoded report of each delta
+ *
+ * The reports are encoded for a target protocol (cf. protocol.h) and all have the same size; regions
+ * the protocol does not have are not stored. Playback maps the file, checks that it was compiled for
+ * the keyboard's protocol and sends each frame's reports followed by the commit report at the
+ * compiled frame rate, i.e. nothing is computed at all.
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include "msiklm.h"
+#include "effect.h"
+#include "protocol.h"
+
+#define TIMELINE_MAGIC        "MSIKLMTL"
+#define TIMELINE_VERSION      2
+#define TIMELINE_MAX_SEGMENTS 256
+#define TIMELINE_MAX_REGIONS  7
+#define TIMELINE_MAX_FRAMES   10000000 //e.g. more than 90 hours at 30 fps
+#define TIMELINE_COMMIT_SIZE  64       //maximal size of the commit report
+#define TIMELINE_CHUNK_FRAMES 256      //frames per task of the thread pool
+
+/**
+ * @brief timeline segment struct: an effect or static colors for a certain duration
+ */
+struct timeline_segment
+{
+    double duration;                           //duration in seconds
+    bool is_effect;
+    struct color colors[TIMELINE_MAX_REGIONS]; //colors of a static segment
+    struct effect effect;                      //effect of an effect segment
+};
+
+/**
+ * @brief timeline script struct: the segments of a light show
+ */
+struct timeline_script
+{
+    int num_regions;
+    int num_segments;
+    struct timeline_segment segments[TIMELINE_MAX_SEGMENTS];
+};
+
+/**
+ * @brief timeline header struct: the header of a compiled timeline file (all positions are byte offsets from the file's start)
+ */
+struct timeline_header
+{
+    char magic[8];                             //TIMELINE_MAGIC without the terminating null
+    uint32_t version;
+    uint32_t fps;
+    uint32_t num_regions;
+    uint32_t num_frames;
+    uint32_t num_deltas;
+    uint32_t report_size;
+    char protocol[32];                         //name of the protocol the reports are encoded for
+    byte commit[TIMELINE_COMMIT_SIZE];         //the commit report that is sent after each frame with deltas
+    uint32_t commit_size;
+    uint32_t reserved;
+    uint64_t offsets_position;
+    uint64_t regions_position;
+    uint64_t reports_position;
+};
+
+/**
+ * @brief compiler statistics struct: what the compiler did
+ */
+struct timeline_stats
+{
+    int threads;                               //number of worker threads
+    unsigned long frames;                      //number of rendered frames
+    unsigned long deltas;                      //number of stored region changes
+    unsigned long steals;                      //number of tasks that were stolen by another worker
+    unsigned long long size;                   //file size in bytes
+    double seconds;                            //compile time in seconds
+};
+
+/**
+ * @brief loads a timeline script
+ * @param script the script
+ * @param path the path of the script file
+ * @param num_regions the number of regions to render, starting with the left one
+ * @returns 0 on success, otherwise the (positive) line number of the first invalid line or -1 if the file could not be read or is empty
+ */
+int timeline_load(struct timeline_script* script, const char* path, int num_regions);
+
+/**
+ * @brief renders a script at the given frame rate and writes the deltas of all frames into a timeline file
+ * @param script the script
+ * @param protocol the protocol the reports are encoded for
+ * @param fps the frame rate
+ * @param num_threads the number of worker threads (at least 1)
+ * @param path the path of the timeline file; an existing file is replaced
+ * @param stats the compiler statistics (might be null)
+ * @returns 0 on success, -1 on error (e.g. if the protocol's reports do not fit into a timeline file)
+ */
+int timeline_compile(const struct timeline_script* script, const struct protocol* protocol, int fps, int num_threads, const char* path, struct timeline_stats* stats);
+
+/**
+ * @brief plays a timeline file until it ends or SIGINT / SIGTERM is received
+ * @param dev the hid device
+ * @param path the path of the timeline file
+ * @param loop true to restart the timeline whenever it ends
+ * @returns 0 on success, -1 on error (e.g. if the file is invalid or encoded for a different protocol than the keyboard's one)
+ */
+int timeline_play(hid_device* dev, const char* path, bool loop);
+
+#endif //TIMELINE_H
@@ -0,0 +1,40 @@
+/**
+ * @file bench_effect.c
+ *
+ * @brief benchmark of the frame cost of the software effects (rendering 7 regions per frame)
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "animation.h"
+#include "effect.h"
+
+#define BENCH_FRAMES 10000000
+
+int main()
+{
+    static const char* names[] = { "breathe", "wave", "rainbow", "comet", "sweep", "strobe" };
+    struct color stops[3] = { { custom, 255, 0, 0 }, { custom, 0, 255, 0 }, { custom, 0, 0, 255 } };
+    static struct effect effect;
+    volatile unsigned sink = 0;
+
+    for (int type=effect_breathe; type<=effect_strobe; ++type)
+    {
+        struct timespec start, init_end, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        effect_init(&effect, type, stops, 3, 2, 1, -1, EFFECT_MAX_REGIONS);
+        clock_gettime(CLOCK_MONOTONIC, &init_end);
+
+        struct color frame[EFFECT_MAX_REGIONS];
+        for (int i=0; i<BENCH_FRAMES; ++i)
+        {
+            effect_render_at(&effect, frame, EFFECT_MAX_REGIONS, i * 0.0167);
+            sink += frame[i % EFFECT_MAX_REGIONS].red;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        printf("bench_effect: %-8s init %8.1f us, %6.1f ns/frame\n", names[type],
+               timespec_seconds_between(&start, &init_end) * 1e6, timespec_seconds_between(&init_end, &end) * 1e9 / BENCH_FRAMES);
+    }
+    return sink == 0xffffffff; //keeps the rendering from being optimized away
+}
@@ -0,0 +1,99 @@
+/**
+ * @file bench_procwatch.c
+ *
+ * @brief benchmark of the event handling of the process watcher: a synthetic event storm and a real fork/exec storm
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "animation.h"
+#include "procwatch.h"
+#include "sim.h"
+
+#define BENCH_EVENTS    1000000
+#define BENCH_PROCESSES 2000
+
+/**
+ * @brief prints the handling statistics of a watcher
+ */
+static void print_stats(const char* name, const struct procwatch* watch)
+{
+    printf("bench_procwatch: %-9s %8lu events, %6lu switches, %8.1f ns per event\n", name, watch->events, watch->switches,
+           watch->events > 0 ? (double)watch->handling_ns / watch->events : 0.0);
+}
+
+int main()
+{
+    //the profiles: one for the storm's executable, one for a program that is not started and the default
+    char path[] = "/tmp/bench_procwatchXXXXXX";
+    int fd = mkstemp(path);
+    FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (file == NULL)
+        return 1;
+    fprintf(file, "true red\nsteam green\ndefault blue\n");
+    fclose(file);
+
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+    static struct procwatch watch;
+    int ret = dev != NULL && procwatch_load(&watch, path, keyboard_protocol(dev)) == 0 ? 0 : 1;
+    unlink(path);
+
+    //synthetic storm: mostly programs without a profile, every 16th one has a profile and causes two switches
+    static const char* executables[] = { "bash", "grep", "sed", "cat", "make", "gcc", "cc1", "as", "ld", "sh", "ls", "git", "awk", "sort", "find", "true" };
+    for (int i=0; i<BENCH_EVENTS / 2 && ret == 0; ++i)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = 1000 + i % 30000;
+        ret = procwatch_exec(&watch, dev, pid, executables[i % 16]) == 0 && procwatch_exit(&watch, dev, pid) == 0 ? 0 : 1;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        watch.events += 2;
+        watch.handling_ns += (long long)(timespec_seconds_between(&start, &end) * 1e9);
+    }
+    print_stats("synthetic", &watch);
+
+    //real storm: the watcher runs in a child process while short-lived processes are forked and executed as fast as possible
+    watch.events = watch.switches = 0;
+    watch.handling_ns = 0;
+    fflush(stdout);
+    pid_t watcher = ret == 0 ? fork() : -1;
+    if (watcher == 0)
+    {
+        int run = procwatch_run(&watch, dev);
+        if (run == 0)
+            print_stats("fork/exec", &watch);
+        else
+            printf("bench_procwatch: fork/exec storm skipped (the process connector requires root)\n");
+        fflush(stdout);
+        _exit(0);
+    }
+    else if (watcher > 0)
+    {
+        usleep(200000); //the watcher subscribes to the connector
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i=0; i<BENCH_PROCESSES; ++i)
+        {
+            pid_t child = fork();
+            if (child == 0)
+            {
+                execl("/bin/true", "true", (char*)NULL);
+                _exit(1);
+            }
+            waitpid(child, NULL, 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        usleep(200000); //the watcher handles the remaining events
+        kill(watcher, SIGTERM);
+        waitpid(watcher, NULL, 0);
+        printf("bench_procwatch: %d processes forked and executed in %.1f ms\n", BENCH_PROCESSES, timespec_seconds_between(&start, &end) * 1000);
+    }
+
+    close_keyboard(dev);
+    return ret;
+}
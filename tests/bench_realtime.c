@@ -0,0 +1,102 @@
+/**
+ * @file bench_realtime.c
+ *
+ * @brief benchmark of the frame jitter under CPU load: the frame loop with normal scheduling and with the real-time profile
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "animation.h"
+#include "realtime.h"
+#include "sim.h"
+
+#define BENCH_FRAMES   1000
+#define BENCH_INTERVAL 2000000L //frame interval in nanoseconds (500 fps)
+#define BENCH_MAX_LOAD 64
+
+/**
+ * @brief returns the upper bound of the bucket that contains the given percentile of the frames
+ */
+static long percentile_us(const struct jitter_histogram* histogram, double percentile)
+{
+    unsigned long frames = 0;
+    int bucket = 0;
+    while (bucket < JITTER_BUCKETS - 1 && (frames += histogram->buckets[bucket]) < histogram->frames * percentile)
+        ++bucket;
+    return 1L << bucket;
+}
+
+/**
+ * @brief runs the frame loop of animate() (absolute deadlines, late frames are skipped) and records the jitter of each frame
+ */
+static void run_frames(hid_device* dev, const struct realtime_options* options, struct jitter_histogram* jitter)
+{
+    if (realtime_enter(options) != 0)
+        printf("bench_realtime: the real-time profile could not be applied completely (requires root)\n");
+    jitter_reset(jitter);
+
+    struct timespec deadline, now;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for (int i=0; i<BENCH_FRAMES; ++i)
+    {
+        timespec_advance(&deadline, BENCH_INTERVAL);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        jitter_record(jitter, &deadline, &now);
+        set_color(dev, (struct color){ custom, (byte)i, 0, 0 }, left, rgb);
+        set_mode(dev, normal);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_seconds_between(&now, &deadline) < 0)
+            deadline = now;
+    }
+    realtime_leave(options);
+}
+
+int main()
+{
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+
+    //one busy loop per CPU keeps every CPU saturated with normal-priority work
+    long num_load = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_load < 1)
+        num_load = 1;
+    else if (num_load > BENCH_MAX_LOAD)
+        num_load = BENCH_MAX_LOAD;
+    pid_t load[BENCH_MAX_LOAD];
+    for (int i=0; i<num_load; ++i)
+    {
+        load[i] = fork();
+        if (load[i] == 0)
+            for (;;);
+    }
+
+    struct realtime_options normal_options, realtime_options;
+    realtime_options_init(&normal_options);
+    realtime_options_init(&realtime_options);
+    realtime_options.policy = realtime_fifo;
+    realtime_options.lock_memory = true;
+
+    const char* names[2] = { "normal  ", "realtime" };
+    const struct realtime_options* options[2] = { &normal_options, &realtime_options };
+    for (int i=0; i<2; ++i)
+    {
+        struct jitter_histogram jitter;
+        run_frames(dev, options[i], &jitter);
+        printf("bench_realtime: %s %d frames, %ld busy loops, p50 < %ld us, p99 < %ld us, max. %.1f us\n", names[i], BENCH_FRAMES, num_load,
+               percentile_us(&jitter, 0.5), percentile_us(&jitter, 0.99), (double)jitter.max_ns / 1000);
+    }
+
+    for (int i=0; i<num_load; ++i)
+    {
+        kill(load[i], SIGKILL);
+        waitpid(load[i], NULL, 0);
+    }
+    close_keyboard(dev);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file bench_shared.c
+ *
+ * @brief benchmark of the shared state: publishing and snapshots without and with concurrent writer processes
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "animation.h"
+#include "shared.h"
+
+#define BENCH_OPERATIONS 10000000
+#define BENCH_WRITERS    2
+
+int main()
+{
+    struct shared_state* state = mmap(NULL, sizeof(struct shared_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    struct color colors[SHARED_MAX_REGIONS] = { { custom, 255, 0, 0 } };
+    struct shared_snapshot snapshot = { 0 };
+    volatile unsigned sink = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<BENCH_OPERATIONS; ++i)
+    {
+        colors[0].blue = (byte)i;
+        shared_state_publish(state, colors, SHARED_MAX_REGIONS, rgb, normal);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("bench_shared: publish             %6.1f ns\n", timespec_seconds_between(&start, &end) * 1e9 / BENCH_OPERATIONS);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<BENCH_OPERATIONS; ++i)
+        sink += shared_state_changed(state, &snapshot);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("bench_shared: changed             %6.1f ns\n", timespec_seconds_between(&start, &end) * 1e9 / BENCH_OPERATIONS);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<BENCH_OPERATIONS; ++i)
+        sink += shared_state_snapshot(state, &snapshot) + snapshot.colors[0].blue;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("bench_shared: snapshot            %6.1f ns\n", timespec_seconds_between(&start, &end) * 1e9 / BENCH_OPERATIONS);
+
+    //snapshots while writer processes publish as fast as they can
+    pid_t writers[BENCH_WRITERS];
+    for (int w=0; w<BENCH_WRITERS; ++w)
+    {
+        writers[w] = fork();
+        if (writers[w] == 0)
+        {
+            for (unsigned i=0; ; ++i)
+            {
+                colors[0].green = (byte)i;
+                shared_state_publish(state, colors, SHARED_MAX_REGIONS, rgb, normal);
+            }
+        }
+    }
+
+    unsigned long failed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<BENCH_OPERATIONS / 10; ++i)
+        if (shared_state_snapshot(state, &snapshot) != 0)
+            ++failed;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("bench_shared: contended snapshot  %6.1f ns (%d writers, %lu given up)\n",
+           timespec_seconds_between(&start, &end) * 1e9 / (BENCH_OPERATIONS / 10), BENCH_WRITERS, failed);
+
+    for (int w=0; w<BENCH_WRITERS; ++w)
+    {
+        kill(writers[w], SIGKILL);
+        waitpid(writers[w], NULL, 0);
+    }
+    return sink == 0xffffffff; //keeps the loops from being optimized away
+}
@@ -0,0 +1,48 @@
+/**
+ * @file bench_timeline.c
+ *
+ * @brief benchmark of the timeline compiler: compile throughput and stolen tasks of the thread pool with different numbers of workers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "timeline.h"
+
+#define BENCH_FPS 60
+
+int main()
+{
+    int ret = 1;
+    char script_path[] = "/tmp/bench_timeline_scriptXXXXXX";
+    char timeline_path[] = "/tmp/bench_timeline_fileXXXXXX";
+    int script_fd = mkstemp(script_path);
+    int timeline_fd = mkstemp(timeline_path);
+    FILE* file = script_fd >= 0 ? fdopen(script_fd, "w") : NULL;
+    if (file != NULL && timeline_fd >= 0)
+    {
+        //a fixed show of one hour with segments of different render costs
+        fprintf(file, "900 wave red,green,blue 2\n900 rainbow\n900 comet red,blue 3\n600 breathe white 4\n300 red,green,blue,white,red,green,blue\n");
+        fclose(file);
+        close(timeline_fd);
+
+        static struct timeline_script script;
+        ret = timeline_load(&script, script_path, TIMELINE_MAX_REGIONS) == 0 ? 0 : 1;
+
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int threads[4] = { 1, 2, 4, num_cpus > 0 ? (int)num_cpus : 1 };
+        for (int i=0; i<4 && ret == 0; ++i)
+        {
+            struct timeline_stats stats;
+            if (timeline_compile(&script, &region_protocol, BENCH_FPS, threads[i], timeline_path, &stats) == 0)
+                printf("bench_timeline: %3d threads %9lu frames %10.0f frames/s %8lu steals %9lu deltas\n",
+                       stats.threads, stats.frames, stats.frames / stats.seconds, stats.steals, stats.deltas);
+            else
+                ret = 1;
+        }
+    }
+
+    unlink(script_path);
+    unlink(timeline_path);
+    return ret;
+}
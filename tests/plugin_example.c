@@ -0,0 +1,57 @@
+/**
+ * @file plugin_example.c
+ *
+ * @brief example effect plugin used by the plugin tests: a red ramp whose render time can be stretched to exceed the budget
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "plugin.h"
+
+#ifndef PLUGIN_EXAMPLE_ABI
+#define PLUGIN_EXAMPLE_ABI MSIKLM_PLUGIN_ABI //the tests build a second copy with an incompatible version
+#endif
+
+#define PLUGIN_EXAMPLE_SPIN_ENV "PLUGIN_EXAMPLE_SPIN_US" //busy time per frame in microseconds
+
+const int msiklm_plugin_abi = PLUGIN_EXAMPLE_ABI;
+
+int msiklm_plugin_init(int num_regions, void** state)
+{
+    int ret = -1;
+    long* spin_ns = malloc(sizeof(long));
+    if (num_regions > 0 && spin_ns != NULL)
+    {
+        const char* spin = getenv(PLUGIN_EXAMPLE_SPIN_ENV);
+        *spin_ns = spin != NULL ? atol(spin) * 1000 : 0;
+        *state = spin_ns;
+        ret = 0;
+    }
+    else
+    {
+        free(spin_ns);
+    }
+    return ret;
+}
+
+void msiklm_plugin_render(void* state, struct color* frame, int num_regions, double t, double dt)
+{
+    (void)dt;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    while ((now.tv_sec - start.tv_sec) * 1000000000L + now.tv_nsec - start.tv_nsec < *(const long*)state);
+
+    //the profile is deliberately left invalid, the host has to fix it
+    for (int i=0; i<num_regions; ++i)
+    {
+        frame[i].profile = (enum color_profile)-1;
+        frame[i].red = (byte)(t * 50);
+    }
+}
+
+void msiklm_plugin_destroy(void* state)
+{
+    free(state);
+}
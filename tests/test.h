@@ -0,0 +1,33 @@
+/**
+ * @file test.h
+ *
+ * @brief header file for the minimal test helpers shared by all tests (cf. make test)
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+/**
+ * @brief checks a condition; a failed check is reported with its location, the test continues
+ */
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++test_failures; \
+        } \
+    } while (0)
+
+/**
+ * @brief prints the result of a test program and returns its exit code
+ */
+#define TEST_RESULT(name) \
+    (printf("%s: %s\n", name, test_failures == 0 ? "passed" : "FAILED"), test_failures == 0 ? 0 : 1)
+
+#endif //TEST_H
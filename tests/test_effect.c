@@ -0,0 +1,78 @@
+/**
+ * @file test_effect.c
+ *
+ * @brief tests of the software effects: deterministic rendering and the reversed direction
+ */
+
+#include <string.h>
+#include "effect.h"
+#include "test.h"
+
+/**
+ * @brief checks if two colors have the same rgb values
+ */
+static bool same_color(struct color a, struct color b)
+{
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+/**
+ * @brief returns the index of the brightest region of a frame
+ */
+static int brightest(const struct color* frame, int num_regions)
+{
+    int ret = 0;
+    for (int i=1; i<num_regions; ++i)
+        if (frame[i].red + frame[i].green + frame[i].blue > frame[ret].red + frame[ret].green + frame[ret].blue)
+            ret = i;
+    return ret;
+}
+
+int main()
+{
+    struct color stops[2] = { { custom, 255, 0, 0 }, { custom, 0, 0, 255 } };
+    static struct effect right, left;
+
+    //the reversed direction mirrors the regions of every effect at every point in time
+    for (int type=effect_breathe; type<=effect_strobe; ++type)
+    {
+        for (int num_regions=1; num_regions<=EFFECT_MAX_REGIONS; ++num_regions)
+        {
+            CHECK(effect_init(&right, type, stops, 2, 1.5, 1, -1, num_regions) == 0);
+            CHECK(effect_init(&left, type, stops, 2, 1.5, -1, -1, num_regions) == 0);
+            for (double t=0; t<4; t+=0.037)
+            {
+                struct color a[EFFECT_MAX_REGIONS], b[EFFECT_MAX_REGIONS], c[EFFECT_MAX_REGIONS];
+                effect_render_at(&right, a, num_regions, t);
+                effect_render_at(&left, b, num_regions, t);
+                effect_render_at(&left, c, num_regions, t);
+                for (int i=0; i<num_regions; ++i)
+                {
+                    CHECK(same_color(a[i], b[num_regions - 1 - i]));
+                    CHECK(same_color(b[i], c[i]));
+                }
+            }
+        }
+    }
+
+    //the comet's head moves towards the left and its tail follows on the right side of the head
+    struct color white[1] = { { custom, 255, 255, 255 } };
+    CHECK(effect_init(&left, effect_comet, white, 1, 1, -1, -1, 7) == 0);
+    int moves = 0, tails_behind = 0, frames = 0;
+    int previous = -1;
+    for (double t=0; t<1; t+=1.0/70, ++frames)
+    {
+        struct color frame[EFFECT_MAX_REGIONS];
+        effect_render_at(&left, frame, 7, t);
+        int head = brightest(frame, 7);
+        if (previous >= 0 && head != previous)
+            moves += head == (previous + 6) % 7 ? 1 : -1;
+        if (head < 6 && frame[head + 1].red >= (head > 0 ? frame[head - 1].red : 0))
+            ++tails_behind;
+        previous = head;
+    }
+    CHECK(moves > 0);
+    CHECK(tails_behind > frames / 2);
+
+    return TEST_RESULT("test_effect");
+}
@@ -0,0 +1,57 @@
+/**
+ * @file test_fade.c
+ *
+ * @brief tests of the cross-fade against the simulated keyboard: paced steps, exact endpoints and the end of the fade on time
+ */
+
+#include <stdlib.h>
+#include "fade.h"
+#include "sim.h"
+#include "test.h"
+
+#define TEST_REGIONS     3
+#define TEST_DURATION_MS 400
+
+int main()
+{
+    //the default timing model of the simulated keyboard (1 ms per report, at most 250 reports per second)
+    setenv(SIM_ENV, "", 1);
+    hid_device* dev = open_keyboard();
+    CHECK(dev != NULL);
+
+    struct color from[TEST_REGIONS] = { { custom, 255, 0, 0 }, { custom, 0, 255, 0 }, { custom, 0, 0, 255 } };
+    struct color to[TEST_REGIONS] = { { custom, 0, 0, 255 }, { custom, 255, 255, 255 }, { custom, 0, 0, 0 } };
+    struct color state[SIM_NUM_REGIONS];
+    enum mode mode;
+
+    //the fade assumes that the keyboard shows the source colors already
+    for (int i=0; i<TEST_REGIONS; ++i)
+        CHECK(set_color(dev, from[i], i+1, rgb) > 0);
+    CHECK(set_mode(dev, normal) > 0);
+    unsigned long received = sim_get_stats()->received;
+
+    struct fade_stats stats;
+    CHECK(fade(dev, from, to, TEST_REGIONS, TEST_DURATION_MS, &stats) == 0);
+
+    //the steps are paced at FADE_MIN_INTERVAL (or slower), every report is accounted for
+    CHECK(stats.steps >= 2 && stats.steps <= TEST_DURATION_MS * 1000000L / FADE_MIN_INTERVAL + 2);
+    CHECK(stats.reports > 0 && (unsigned long)stats.reports == sim_get_stats()->received - received);
+    CHECK(stats.latency > 0 && stats.latency < FADE_MIN_INTERVAL / 1e9);
+
+    //the fade ends exactly at the target colors and at most one step late
+    sim_get_state(state, &mode);
+    CHECK(mode == normal);
+    for (int i=0; i<TEST_REGIONS; ++i)
+        CHECK(state[i].red == to[i].red && state[i].green == to[i].green && state[i].blue == to[i].blue);
+    CHECK(stats.lateness >= 0 && stats.lateness < FADE_MIN_INTERVAL / 1e9);
+
+    //a fade without a duration sets the target colors at once
+    CHECK(fade(dev, to, from, TEST_REGIONS, 0, &stats) == 0);
+    CHECK(stats.steps == 1 && stats.reports == TEST_REGIONS + 1);
+    sim_get_state(state, &mode);
+    for (int i=0; i<TEST_REGIONS; ++i)
+        CHECK(state[i].red == from[i].red && state[i].green == from[i].green && state[i].blue == from[i].blue);
+
+    close_keyboard(dev);
+    return TEST_RESULT("test_fade");
+}
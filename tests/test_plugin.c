@@ -0,0 +1,50 @@
+/**
+ * @file test_plugin.c
+ *
+ * @brief tests of the plugin loader: plugin paths, the ABI check and the enforcement of the render-time budget
+ */
+
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "plugin.h"
+#include "test.h"
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    struct plugin plugin;
+    struct color frame[3];
+    memset(frame, 0, sizeof(frame));
+
+    //the example plugins are built next to the test binary (cf. make test)
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s", argv[0]);
+    CHECK(chdir(dirname(directory)) == 0);
+
+    //a plugin in the working directory is found without ./, a missing one and an incompatible ABI are rejected
+    CHECK(plugin_load(&plugin, "plugin_missing.so", 3, 0) == -1 && plugin.handle == NULL);
+    CHECK(plugin_load(&plugin, "plugin_example_abi0.so", 3, 0) == -1 && plugin.handle == NULL);
+    CHECK(plugin_load(&plugin, "plugin_example.so", 3, 0) == 0 && plugin.handle != NULL);
+
+    //the plugin renders in place, the host keeps the profile valid
+    CHECK(plugin_render(&plugin, frame, 3, 1.0, 0.1) == 0);
+    for (int i=0; i<3; ++i)
+        CHECK(frame[i].profile == custom && frame[i].red == 50);
+    CHECK(plugin.frames == 1 && plugin.overruns == 0);
+    plugin_unload(&plugin);
+    CHECK(plugin.handle == NULL);
+
+    //a plugin exceeding its budget keeps running until it did so PLUGIN_MAX_OVERRUNS frames in a row
+    setenv("PLUGIN_EXAMPLE_SPIN_US", "2000", 1);
+    CHECK(plugin_load(&plugin, "./plugin_example.so", 3, 100000) == 0);
+    for (int i=1; i<PLUGIN_MAX_OVERRUNS; ++i)
+        CHECK(plugin_render(&plugin, frame, 3, i * 0.1, 0.1) == 0);
+    CHECK(plugin_render(&plugin, frame, 3, 3.0, 0.1) == -1);
+    CHECK(plugin.overruns == PLUGIN_MAX_OVERRUNS && plugin.consecutive == PLUGIN_MAX_OVERRUNS);
+    CHECK(plugin.worst_ns >= 2000000);
+    plugin_unload(&plugin);
+
+    return TEST_RESULT("test_plugin");
+}
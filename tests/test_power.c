@@ -0,0 +1,163 @@
+/**
+ * @file test_power.c
+ *
+ * @brief tests of the power policy: AC, battery and missing supplies in a fake sysfs tree, activity and hung-up devices in a fake input tree
+ */
+
+#define _XOPEN_SOURCE 700
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "animation.h"
+#include "power.h"
+#include "sim.h"
+#include "test.h"
+
+/**
+ * @brief writes a single line attribute of a fake power supply (creating the supply's directory if required)
+ */
+static void write_attribute(const char* root, const char* supply, const char* attribute, const char* value)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, supply);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/%s/%s", root, supply, attribute);
+    FILE* file = fopen(path, "w");
+    if (file != NULL)
+    {
+        fprintf(file, "%s\n", value);
+        fclose(file);
+    }
+}
+
+/**
+ * @brief removes a file or directory of the fake trees (cf. nftw)
+ */
+static int remove_entry(const char* path, const struct stat* status, int flag, struct FTW* ftw)
+{
+    (void)status;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+/**
+ * @brief renders a constant color, the animation under test only has to keep running
+ */
+static int render_constant(void* context, struct color* frame, int num_regions, double t, double dt)
+{
+    (void)context;
+    (void)t;
+    (void)dt;
+    for (int i=0; i<num_regions; ++i)
+        frame[i] = (struct color){ custom, 0, 255, 0 };
+    return 0;
+}
+
+int main()
+{
+    char root[] = "/tmp/msiklm-power-XXXXXX";
+    CHECK(mkdtemp(root) != NULL);
+    char supply_root[256], input_root[256], path[512];
+    snprintf(supply_root, sizeof(supply_root), "%s/power_supply", root);
+    snprintf(input_root, sizeof(input_root), "%s/input", root);
+    mkdir(supply_root, 0755);
+    mkdir(input_root, 0755);
+
+    //the mains adapter decides if there is one, otherwise the battery status; no supply at all is a desktop on AC
+    CHECK(power_on_battery(supply_root) == 0);
+    write_attribute(supply_root, "BAT0", "type", "Battery");
+    write_attribute(supply_root, "BAT0", "status", "Discharging");
+    CHECK(power_on_battery(supply_root) == 1);
+    write_attribute(supply_root, "BAT0", "status", "Charging");
+    CHECK(power_on_battery(supply_root) == 0);
+    write_attribute(supply_root, "AC", "type", "Mains");
+    write_attribute(supply_root, "AC", "online", "0");
+    CHECK(power_on_battery(supply_root) == 1);
+    write_attribute(supply_root, "AC", "online", "1");
+    CHECK(power_on_battery(supply_root) == 0);
+    snprintf(path, sizeof(path), "%s/missing", root);
+    CHECK(power_on_battery(path) == -1);
+
+    //a fifo is an input device that never hangs up, an empty regular file is one that reads end of file (i.e. it was unplugged)
+    snprintf(path, sizeof(path), "%s/event0", input_root);
+    CHECK(mkfifo(path, 0600) == 0);
+    int input = open(path, O_RDWR | O_NONBLOCK);
+    CHECK(input >= 0);
+    snprintf(path, sizeof(path), "%s/event1", input_root);
+    close(open(path, O_WRONLY | O_CREAT, 0600));
+
+    struct power_policy policy;
+    power_policy_init(&policy);
+    policy.supply_root = supply_root;
+    policy.input_root = input_root;
+    policy.idle_timeout = 1;
+    struct power_monitor monitor;
+    CHECK(power_monitor_open(&monitor, &policy) == 0);
+    CHECK(monitor.num_inputs == 2 && !monitor.on_battery);
+    CHECK(power_update(&monitor) == power_active);
+    CHECK(monitor.num_inputs == 1 && monitor.policy.idle_timeout == 1);
+    CHECK(power_frame_interval(&monitor, power_active) == 1000000000L / policy.fps_ac);
+
+    //unplugging the adapter is noticed at the next supply check, without a battery frame rate the firmware takes over
+    write_attribute(supply_root, "AC", "online", "0");
+    monitor.last_supply_check -= 60;
+    CHECK(power_update(&monitor) == power_battery);
+    CHECK(power_frame_interval(&monitor, power_battery) == 0);
+    write_attribute(supply_root, "AC", "online", "1");
+    monitor.last_supply_check -= 60;
+    CHECK(power_update(&monitor) == power_active);
+
+    //no activity times out, an input event wakes up
+    CHECK(power_wait_activity(&monitor, 10) == 0);
+    CHECK(write(input, "x", 1) == 1);
+    CHECK(power_wait_activity(&monitor, 1000) == 1);
+
+    //the keyboard is released while idle, the sleep ends at its timeout or at the next input event
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+    CHECK(dev != NULL);
+    monitor.last_activity -= policy.idle_timeout;
+    CHECK(power_update(&monitor) == power_idle);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CHECK(power_sleep(&monitor, &dev, 100) == 1 && dev == NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK(timespec_seconds_between(&start, &end) >= 0.09 && timespec_seconds_between(&start, &end) < 0.5);
+    CHECK(write(input, "x", 1) == 1);
+    CHECK(power_sleep(&monitor, &dev, -1) == 0 && dev != NULL);
+    CHECK(power_update(&monitor) == power_active);
+
+    //once the last input device hung up, activity cannot be detected anymore and idling is disabled
+    close(input);
+    snprintf(path, sizeof(path), "%s/event0", input_root);
+    unlink(path);
+    close(open(path, O_WRONLY | O_CREAT, 0600));
+    power_monitor_close(&monitor);
+    CHECK(power_monitor_open(&monitor, &policy) == 0);
+    CHECK(monitor.num_inputs == 2);
+    CHECK(power_wait_activity(&monitor, 1000) == 1);
+    CHECK(monitor.num_inputs == 0 && monitor.policy.idle_timeout == 0);
+    power_monitor_close(&monitor);
+
+    //the duration also ends an animation while the user is idle (which it is after one to two seconds)
+    snprintf(path, sizeof(path), "%s/event0", input_root);
+    unlink(path);
+    CHECK(mkfifo(path, 0600) == 0);
+    struct animation_options options;
+    animation_options_init(&options);
+    options.policy = policy;
+    options.duration = 2.5;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CHECK(animate(&dev, render_constant, NULL, &options) == 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK(timespec_seconds_between(&start, &end) >= 2.5 && timespec_seconds_between(&start, &end) < 3.0);
+    if (dev != NULL)
+        close_keyboard(dev);
+
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return TEST_RESULT("test_power");
+}
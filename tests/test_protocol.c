@@ -0,0 +1,112 @@
+/**
+ * @file test_protocol.c
+ *
+ * @brief tests of the protocol encoders against golden reports, of the per-device protocol selection and of the simulated per-key keyboard
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+#include "sim.h"
+#include "test.h"
+
+int main()
+{
+    byte buffer[PROTOCOL_MAX_REPORT_SIZE];
+    struct color purple_color = { purple, 255, 0, 255 };
+    struct color rgb_color = { custom, 18, 52, 86 };
+
+    //region protocol: rgb, set and commit requests
+    static const byte rgb_report[8] = { 1, 2, 64, 2, 18, 52, 86, 236 };
+    CHECK(region_protocol.encode_color(buffer, rgb_color, middle, rgb) == 8 && memcmp(buffer, rgb_report, 8) == 0);
+
+    static const byte set_report[8] = { 1, 2, 66, 7, 7, 1, 0, 236 };
+    CHECK(region_protocol.encode_color(buffer, purple_color, mouse, medium) == 8 && memcmp(buffer, set_report, 8) == 0);
+
+    static const byte off_report[8] = { 1, 2, 66, 1, 0, 3, 0, 236 };
+    CHECK(region_protocol.encode_color(buffer, purple_color, left, off) == 8 && memcmp(buffer, off_report, 8) == 0);
+
+    static const byte commit_report[8] = { 1, 2, 65, 3, 0, 0, 0, 236 };
+    CHECK(region_protocol.encode_mode(buffer, breathe) == 8 && memcmp(buffer, commit_report, 8) == 0);
+    CHECK(region_protocol.max_keys_per_report == 0 && region_protocol.encode_keys == NULL);
+
+    //per-key protocol: header with the little endian count, one entry per key and zero padding up to the full size
+    struct key_color keys[300];
+    for (int i=0; i<300; ++i)
+        keys[i] = (struct key_color){ (byte)i, (byte)(i * 3), (byte)(i * 5), (byte)(i * 7) };
+    static const byte keys_report[12] = { 0x0e, 0, 2, 0, 4, 12, 20, 28, 5, 15, 25, 35 };
+    CHECK(per_key_protocol.encode_keys(buffer, &keys[4], 2) == PROTOCOL_MAX_REPORT_SIZE && memcmp(buffer, keys_report, 12) == 0);
+    bool padded = true;
+    for (int i=12; i<PROTOCOL_MAX_REPORT_SIZE; ++i)
+        padded = padded && buffer[i] == 0;
+    CHECK(padded);
+
+    int max_keys = per_key_protocol.max_keys_per_report;
+    CHECK(max_keys == 130);
+    CHECK(per_key_protocol.encode_keys(buffer, keys, max_keys) == PROTOCOL_MAX_REPORT_SIZE && buffer[2] == 130 && buffer[3] == 0);
+    CHECK(buffer[4 + 4 * (max_keys - 1)] == max_keys - 1 && buffer[4 + 4 * (max_keys - 1) + 3] == (byte)((max_keys - 1) * 7));
+    CHECK(per_key_protocol.encode_keys(buffer, keys, max_keys + 1) == -1);
+
+    //per-key protocol: emulated regions (with the brightness scaled in thirds), skipped regions and every mode applies the colors
+    CHECK(per_key_protocol.encode_color(buffer, purple_color, left, low) == PROTOCOL_MAX_REPORT_SIZE);
+    static const byte region_report[8] = { 0x0e, 0, 32, 0, 0x29, 85, 0, 85 };
+    CHECK(memcmp(buffer, region_report, 8) == 0);
+    CHECK(per_key_protocol.encode_color(buffer, purple_color, logo, rgb) == 0);
+    CHECK(per_key_protocol.encode_color(buffer, purple_color, mouse, rgb) == 0);
+    static const byte apply_report[4] = { 0x0d, 0, 0, 0 };
+    for (int mode=normal; mode<=wave; ++mode)
+        CHECK(per_key_protocol.encode_mode(buffer, mode) == 64 && memcmp(buffer, apply_report, 4) == 0);
+    CHECK(per_key_protocol.encode_mode(buffer, 0) == -1);
+
+    //a state of seven regions needs three region reports and the apply report on a per-key keyboard
+    static struct report_batch batch;
+    struct color colors[7] = { rgb_color, rgb_color, rgb_color, rgb_color, rgb_color, rgb_color, rgb_color };
+    CHECK(encode_state(&per_key_protocol, colors, 7, rgb, wave, &batch) == 0 && batch.num_reports == 4 && batch.lengths[3] == 64);
+    CHECK(encode_state(&region_protocol, colors, 7, rgb, wave, &batch) == 0 && batch.num_reports == 8 && memcmp(batch.reports[6], (byte[]){ 1, 2, 64, 7 }, 4) == 0);
+
+    //the unverified per-key keyboard is only tried on request
+    const struct device* device = find_device(0x1038, 0x1122);
+    CHECK(device != NULL && device->protocol == &per_key_protocol && !device->verified);
+    device = find_device(0x1770, 0xff00);
+    CHECK(device != NULL && device->protocol == &region_protocol && device->verified);
+
+    //the protocol follows the handle: the simulated keyboard speaks the region protocol and has no per-key colors
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+    CHECK(dev != NULL && keyboard_protocol(dev) == &region_protocol);
+    CHECK(set_keys(dev, keys, 2) == -1);
+    CHECK(set_color(dev, rgb_color, left, rgb) == 8);
+
+    //the simulated keyboard decodes per-key reports as well: a state of seven regions takes one transfer per region with keys and the apply report
+    struct sim_stats before = *sim_get_stats();
+    struct color key_state[SIM_NUM_KEYS];
+    CHECK(encode_state(&per_key_protocol, colors, 7, rgb, normal, &batch) == 0 && send_batch(dev, &batch) == 4);
+    CHECK(sim_get_stats()->received == before.received + 4 && sim_get_stats()->rejected == before.rejected);
+    CHECK(sim_get_stats()->key_reports == before.key_reports + 3 && sim_get_stats()->commits == before.commits + 1);
+    sim_get_keys(key_state);
+    CHECK(key_state[0x29].red == 18 && key_state[0x2c].green == 52 && key_state[0x52].blue == 86 && key_state[0x01].red == 0);
+
+    //a full-keyboard frame is a single transfer plus the apply report, its colors are only visible once applied
+    before = *sim_get_stats();
+    batch.num_reports = 2;
+    batch.lengths[0] = per_key_protocol.encode_keys(batch.reports[0], keys, max_keys);
+    batch.lengths[1] = per_key_protocol.encode_mode(batch.reports[1], normal);
+    CHECK(send_report(dev, batch.reports[0], batch.lengths[0]) == PROTOCOL_MAX_REPORT_SIZE);
+    sim_get_keys(key_state);
+    CHECK(key_state[0x29].red == 18);
+    CHECK(send_batch(dev, &batch) == 2);
+    CHECK(sim_get_stats()->received == before.received + 3 && sim_get_stats()->rejected == before.rejected);
+    CHECK(sim_get_stats()->key_reports == before.key_reports + 2 && sim_get_stats()->commits == before.commits + 1);
+    sim_get_keys(key_state);
+    bool applied = true;
+    for (int i=0; i<max_keys; ++i)
+        applied = applied && key_state[i].red == keys[i].red && key_state[i].green == keys[i].green && key_state[i].blue == keys[i].blue;
+    CHECK(applied);
+
+    //a key report with more keys than fit into it is rejected
+    batch.reports[0][2] = (byte)(max_keys + 1);
+    CHECK(send_report(dev, batch.reports[0], batch.lengths[0]) == -1 && sim_get_stats()->rejected == before.rejected + 1);
+    close_keyboard(dev);
+
+    return TEST_RESULT("test_protocol");
+}
@@ -0,0 +1,159 @@
+/**
+ * @file test_schedule.c
+ *
+ * @brief tests of the schedule evaluation and runner: entries start at their wall-clock time on days with a daylight saving time change
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "schedule.h"
+#include "sim.h"
+#include "test.h"
+
+#define MAR_29_0400_UTC 1774756800.0 //2026-03-29 06:00 CEST
+#define MAR_29_1000_UTC 1774778400.0 //2026-03-29 12:00 CEST
+#define MAR_29_2000_UTC 1774814400.0 //2026-03-29 22:00 CEST
+#define MAR_28_2100_UTC 1774731600.0 //2026-03-28 22:00 CET
+#define MAR_28_2200_UTC 1774735200.0 //2026-03-28 23:00 CET
+#define OCT_25_1100_UTC 1792926000.0 //2026-10-25 12:00 CET
+#define OCT_25_2100_UTC 1792962000.0 //2026-10-25 22:00 CET
+#define MAR_28_2030_UTC 1774729800.0 //2026-03-28 21:30 CET
+
+#define FAKE_MAX_WAITS 16
+
+/**
+ * @brief fake clock struct: a simulated realtime clock that jumps to each deadline and records the state applied before it
+ */
+struct fake_clock
+{
+    double now;                                  //the simulated time in seconds since the epoch
+    double end;                                  //the runner is stopped when it waits for a deadline after the end
+    int waits;                                   //number of waits
+    double deadlines[FAKE_MAX_WAITS];            //the deadline of each wait
+    double applied[FAKE_MAX_WAITS];              //the simulated time of each wait, i.e. when the state before it was applied
+    struct color colors[FAKE_MAX_WAITS];         //the committed color of the left region at each wait
+};
+
+/**
+ * @brief returns the simulated time
+ */
+static int fake_now(void* context, struct timespec* now)
+{
+    const struct fake_clock* clock = (const struct fake_clock*)context;
+    now->tv_sec = (time_t)clock->now;
+    now->tv_nsec = (long)((clock->now - (double)now->tv_sec) * 1e9);
+    return 0;
+}
+
+/**
+ * @brief records the committed state and the deadline, then jumps to the deadline without sleeping (or stops the runner after the end)
+ */
+static int fake_wait_until(void* context, const struct timespec* deadline)
+{
+    int ret = 0;
+    struct fake_clock* clock = (struct fake_clock*)context;
+    double t = (double)deadline->tv_sec + (double)deadline->tv_nsec / 1e9;
+    if (clock->waits < FAKE_MAX_WAITS)
+    {
+        enum mode mode;
+        struct color colors[SIM_NUM_REGIONS];
+        sim_get_state(colors, &mode);
+        clock->deadlines[clock->waits] = t;
+        clock->applied[clock->waits] = clock->now;
+        clock->colors[clock->waits] = colors[0];
+    }
+    ++clock->waits;
+
+    if (t > clock->end || clock->waits >= FAKE_MAX_WAITS)
+    {
+        raise(SIGTERM); //handled by the runner, which then stops without an error
+        ret = -1;
+    }
+    else
+    {
+        clock->now = t;
+    }
+    return ret;
+}
+
+int main()
+{
+    //Europe/Berlin without depending on the installed time zone database
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+
+    static struct schedule schedule;
+    memset(&schedule, 0, sizeof(schedule));
+    schedule.num_entries = 2;
+    schedule.entries[0].start = 6 * 3600;
+    schedule.entries[0].num_regions = 1;
+    schedule.entries[0].colors[0] = (struct color){ custom, 255, 0, 0 };
+    schedule.entries[1].start = 22 * 3600;
+    schedule.entries[1].num_regions = 1;
+    schedule.entries[1].colors[0] = (struct color){ custom, 0, 0, 255 };
+
+    struct color colors[SCHEDULE_MAX_REGIONS];
+    int num_regions = 0;
+
+    //the clocks are set forward on 2026-03-29: 22:00 is still 22:00 in summer time
+    CHECK(schedule_evaluate(&schedule, MAR_29_1000_UTC, colors, &num_regions) == MAR_29_2000_UTC);
+    CHECK(num_regions == 1 && colors[0].red == 255);
+
+    //the night before, the next morning's entry starts at 06:00 summer time, i.e. the night is an hour shorter
+    CHECK(schedule_evaluate(&schedule, MAR_28_2200_UTC, colors, &num_regions) == MAR_29_0400_UTC);
+    CHECK(colors[0].blue == 255);
+
+    //an entry that started yesterday is still active
+    CHECK(schedule_evaluate(&schedule, MAR_29_0400_UTC - 1, colors, &num_regions) == MAR_29_0400_UTC);
+    CHECK(colors[0].blue == 255);
+    CHECK(schedule_evaluate(&schedule, MAR_28_2100_UTC, colors, &num_regions) == MAR_29_0400_UTC);
+
+    //the clocks are set back on 2026-10-25: 22:00 is 22:00 in standard time
+    CHECK(schedule_evaluate(&schedule, OCT_25_1100_UTC, colors, &num_regions) == OCT_25_2100_UTC);
+
+    //a single entry is active all day and starts again at the same wall-clock time
+    schedule.num_entries = 1;
+    schedule.entries[0].start = 22 * 3600;
+    CHECK(schedule_evaluate(&schedule, MAR_28_2100_UTC, colors, &num_regions) == MAR_29_2000_UTC);
+    CHECK(colors[0].red == 255);
+
+    //the runner wakes up exactly once per entry over a day with the change to summer time and applies each entry at its second
+    schedule.num_entries = 3;
+    schedule.entries[0].start = 6 * 3600;
+    schedule.entries[0].colors[0] = (struct color){ custom, 255, 0, 0 };
+    schedule.entries[1].start = 12 * 3600;
+    schedule.entries[1].num_regions = 1;
+    schedule.entries[1].colors[0] = (struct color){ custom, 0, 255, 0 };
+    schedule.entries[2].start = 22 * 3600;
+    schedule.entries[2].num_regions = 1;
+    schedule.entries[2].colors[0] = (struct color){ custom, 0, 0, 255 };
+
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+    CHECK(dev != NULL);
+    struct fake_clock fake;
+    memset(&fake, 0, sizeof(fake));
+    fake.now = MAR_28_2030_UTC;
+    fake.end = MAR_29_2000_UTC;
+    struct schedule_clock clock = { &fake, fake_now, fake_wait_until };
+    struct schedule_stats stats;
+    CHECK(schedule_run(dev, &schedule, &clock, &stats) == 0);
+
+    const double deadlines[] = { MAR_28_2100_UTC, MAR_29_0400_UTC, MAR_29_1000_UTC, MAR_29_2000_UTC, MAR_29_0400_UTC + 86400 };
+    const struct color applied[] = { { custom, 0, 255, 0 }, { custom, 0, 0, 255 }, { custom, 255, 0, 0 }, { custom, 0, 255, 0 }, { custom, 0, 0, 255 } };
+    CHECK(fake.waits == 5);
+    CHECK(stats.wakeups == 4);
+    CHECK(stats.reports == 2 * 5);
+    CHECK(stats.max_lateness == 0);
+    for (int i=0; i<5 && i<fake.waits; ++i)
+    {
+        CHECK(fake.deadlines[i] == deadlines[i]);
+        CHECK(fake.applied[i] == (i == 0 ? MAR_28_2030_UTC : deadlines[i-1]));
+        CHECK(fake.colors[i].red == applied[i].red && fake.colors[i].green == applied[i].green && fake.colors[i].blue == applied[i].blue);
+    }
+    close_keyboard(dev);
+
+    return TEST_RESULT("test_schedule");
+}
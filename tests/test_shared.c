@@ -0,0 +1,199 @@
+/**
+ * @file test_shared.c
+ *
+ * @brief tests of the shared state: concurrent writer processes, a killed and a stopped writer and invalid values
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "animation.h"
+#include "shared.h"
+#include "sim.h"
+#include "test.h"
+
+#define TEST_WRITERS   4
+#define TEST_PUBLISHES 200000
+#define TEST_STOPS     1000
+
+/**
+ * @brief publishes a state whose regions, brightness and mode are all derived from the same value, so a torn snapshot is detected
+ */
+static void publish_value(struct shared_state* state, int value)
+{
+    struct color colors[SHARED_MAX_REGIONS];
+    for (int i=0; i<SHARED_MAX_REGIONS; ++i)
+    {
+        colors[i].profile = custom;
+        colors[i].red = colors[i].green = colors[i].blue = (byte)value;
+    }
+    shared_state_publish(state, colors, SHARED_MAX_REGIONS, rgb, (enum mode)(normal + value % 5));
+}
+
+/**
+ * @brief checks that all values of a snapshot belong to the same publish
+ */
+static bool consistent(const struct shared_snapshot* snapshot)
+{
+    bool ret = snapshot->valid[0] && snapshot->brightness == rgb && snapshot->mode == (enum mode)(normal + snapshot->colors[0].red % 5);
+    for (int i=0; i<SHARED_MAX_REGIONS; ++i)
+        ret = ret && snapshot->valid[i] && snapshot->colors[i].red == snapshot->colors[0].red &&
+              snapshot->colors[i].green == snapshot->colors[0].red && snapshot->colors[i].blue == snapshot->colors[0].red;
+    return ret;
+}
+
+int main()
+{
+    //an anonymous shared mapping has the same layout as the segment without touching the real one
+    struct shared_state* state = mmap(NULL, sizeof(struct shared_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(state != MAP_FAILED);
+    struct shared_snapshot snapshot;
+    publish_value(state, 0);
+
+    //concurrent writer processes never expose a half-updated state and no publish is lost
+    pid_t writers[TEST_WRITERS];
+    for (int w=0; w<TEST_WRITERS; ++w)
+    {
+        writers[w] = fork();
+        if (writers[w] == 0)
+        {
+            for (int i=0; i<TEST_PUBLISHES; ++i)
+                publish_value(state, w * 64 + i % 64);
+            _exit(0);
+        }
+    }
+
+    unsigned long snapshots = 0, torn = 0;
+    for (int finished=0; finished < TEST_WRITERS; )
+    {
+        if (shared_state_snapshot(state, &snapshot) == 0)
+        {
+            ++snapshots;
+            if (!consistent(&snapshot))
+                ++torn;
+        }
+        for (int w=0; w<TEST_WRITERS; ++w)
+            if (writers[w] > 0 && waitpid(writers[w], NULL, WNOHANG) == writers[w])
+            {
+                writers[w] = 0;
+                ++finished;
+            }
+    }
+    CHECK(snapshots > 0);
+    CHECK(torn == 0);
+    CHECK(shared_state_snapshot(state, &snapshot) == 0 && consistent(&snapshot));
+    CHECK(snapshot.sequence == 2u * (TEST_WRITERS * TEST_PUBLISHES + 1));
+
+    //a writer killed in the middle of its update fails snapshots instead of blocking them ...
+    pid_t dead = fork();
+    if (dead == 0)
+        _exit(0);
+    waitpid(dead, NULL, 0);
+    atomic_store(&state->sequence, ((unsigned long long)dead << 32) | (snapshot.sequence + 1));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CHECK(shared_state_snapshot(state, &snapshot) == -1);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK(timespec_seconds_between(&start, &end) < 0.1);
+
+    //... and the next writer takes over after SHARED_STALE_TIME
+    pid_t writer = fork();
+    if (writer == 0)
+    {
+        publish_value(state, 7);
+        _exit(0);
+    }
+    int status = -1;
+    for (int i=0; i<50 && waitpid(writer, &status, WNOHANG) == 0; ++i)
+        usleep(100000);
+    if (status == -1)
+        kill(writer, SIGKILL);
+    CHECK(status == 0);
+    CHECK(shared_state_snapshot(state, &snapshot) == 0 && consistent(&snapshot) && snapshot.colors[0].red == 7);
+
+    //a writer that is stopped in the middle of its update is alive: it is not released however long it is stopped
+    atomic_int* running = mmap(NULL, sizeof(atomic_int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    atomic_store(running, 1);
+    pid_t stopped = fork();
+    if (stopped == 0)
+    {
+        for (int i=0; atomic_load(running); ++i)
+            publish_value(state, i % 64);
+        _exit(0);
+    }
+    bool holding = false;
+    for (int i=0; i<TEST_STOPS && !holding; ++i)
+    {
+        usleep(100);
+        kill(stopped, SIGSTOP);
+        waitpid(stopped, NULL, WUNTRACED);
+        holding = (atomic_load(&state->sequence) & 1) != 0;
+        if (!holding)
+            kill(stopped, SIGCONT);
+    }
+    CHECK(holding);
+
+    writer = fork();
+    if (writer == 0)
+    {
+        publish_value(state, 9);
+        _exit(0);
+    }
+    usleep((useconds_t)(SHARED_STALE_TIME * 1.5e6));
+    CHECK(waitpid(writer, &status, WNOHANG) == 0);
+    CHECK(shared_state_snapshot(state, &snapshot) == -1);
+
+    //once it continues, it finishes its update and the waiting writer takes over without any torn snapshot
+    kill(stopped, SIGCONT);
+    atomic_store(running, 0);
+    torn = 0;
+    status = -1;
+    for (int i=0; i<5000 && waitpid(writer, &status, WNOHANG) == 0; ++i)
+    {
+        if (shared_state_snapshot(state, &snapshot) == 0 && !consistent(&snapshot))
+            ++torn;
+        usleep(1000);
+    }
+    if (status == -1)
+        kill(writer, SIGKILL);
+    CHECK(status == 0);
+    CHECK(waitpid(stopped, &status, 0) == stopped && status == 0);
+    CHECK(torn == 0);
+    CHECK(shared_state_snapshot(state, &snapshot) == 0 && consistent(&snapshot));
+    munmap(running, sizeof(atomic_int));
+
+    //values out of range are never sent to the keyboard
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+    CHECK(dev != NULL);
+    struct shared_snapshot flushed;
+    memset(&flushed, 0, sizeof(flushed));
+    CHECK(shared_state_snapshot(state, &snapshot) == 0);
+    CHECK(shared_state_flush(dev, &snapshot, &flushed) == SHARED_MAX_REGIONS + 1);
+
+    atomic_store(&state->brightness, 1000);
+    CHECK(shared_state_snapshot(state, &snapshot) == 0);
+    CHECK(shared_state_flush(dev, &snapshot, &flushed) == 0);
+    CHECK(flushed.sequence == snapshot.sequence && flushed.brightness == rgb);
+
+    atomic_store(&state->brightness, rgb);
+    atomic_store(&state->mode, 0);
+    CHECK(shared_state_snapshot(state, &snapshot) == 0);
+    CHECK(shared_state_flush(dev, &snapshot, &flushed) == 0);
+
+    //a region with an invalid profile or a custom color with an explicit brightness is skipped
+    atomic_store(&state->mode, normal);
+    atomic_store(&state->regions[0], 0x80000000u | (100u << 24));
+    atomic_store(&state->brightness, high);
+    CHECK(shared_state_snapshot(state, &snapshot) == 0);
+    CHECK(!snapshot.valid[0] && !snapshot.valid[1]);
+    CHECK(shared_state_flush(dev, &snapshot, &flushed) == 1);
+    close_keyboard(dev);
+
+    munmap(state, sizeof(struct shared_state));
+    return TEST_RESULT("test_shared");
+}
@@ -0,0 +1,109 @@
+/**
+ * @file test_timeline.c
+ *
+ * @brief tests of the timeline compiler and player: encoding for the target protocol and validation of the file header
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sim.h"
+#include "test.h"
+#include "timeline.h"
+
+/**
+ * @brief reads the header of a timeline file
+ */
+static int read_header(const char* path, struct timeline_header* header)
+{
+    FILE* file = fopen(path, "rb");
+    int ret = file != NULL && fread(header, sizeof(struct timeline_header), 1, file) == 1 ? 0 : -1;
+    if (file != NULL)
+        fclose(file);
+    return ret;
+}
+
+/**
+ * @brief overwrites the report size in the header of a timeline file
+ */
+static void write_report_size(const char* path, uint32_t report_size)
+{
+    FILE* file = fopen(path, "r+b");
+    if (file != NULL)
+    {
+        fseek(file, offsetof(struct timeline_header, report_size), SEEK_SET);
+        fwrite(&report_size, sizeof(report_size), 1, file);
+        fclose(file);
+    }
+}
+
+int main()
+{
+    char script_path[] = "/tmp/test_timeline_scriptXXXXXX";
+    char region_path[] = "/tmp/test_timeline_regionXXXXXX";
+    char per_key_path[] = "/tmp/test_timeline_per_keyXXXXXX";
+    int fds[3] = { mkstemp(script_path), mkstemp(region_path), mkstemp(per_key_path) };
+    CHECK(fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0);
+    FILE* file = fdopen(fds[0], "w");
+    fprintf(file, "0.2 red,green,blue,white,red,green,blue\n0.2 wave red,blue 1\n");
+    fclose(file);
+    close(fds[1]);
+    close(fds[2]);
+
+    static struct timeline_script script;
+    struct timeline_stats stats;
+    struct timeline_header header;
+    CHECK(timeline_load(&script, script_path, 7) == 0 && script.num_segments == 2);
+
+    //region protocol: one 8-byte report per changed region, all seven regions are stored
+    CHECK(timeline_compile(&script, &region_protocol, 30, 2, region_path, &stats) == 0 && stats.frames == 12);
+    CHECK(read_header(region_path, &header) == 0);
+    CHECK(header.report_size == 8 && header.commit_size == 8 && header.commit[2] == 65 && header.num_deltas == stats.deltas);
+    CHECK(strcmp(header.protocol, region_protocol.name) == 0);
+    unsigned long region_deltas = stats.deltas;
+
+    //per-key protocol: full-size reports and the apply report, regions the protocol does not have are not stored
+    CHECK(timeline_compile(&script, &per_key_protocol, 30, 2, per_key_path, &stats) == 0);
+    CHECK(read_header(per_key_path, &header) == 0);
+    CHECK(header.report_size == PROTOCOL_MAX_REPORT_SIZE && header.commit_size == 64 && header.commit[0] == 0x0d);
+    CHECK(strcmp(header.protocol, per_key_protocol.name) == 0);
+    CHECK(stats.deltas > 0 && stats.deltas < region_deltas);
+    byte* data = NULL;
+    file = fopen(per_key_path, "rb");
+    if (file != NULL && (data = (byte*)malloc(stats.size)) != NULL && fread(data, 1, stats.size, file) == stats.size)
+    {
+        bool known_regions = true;
+        for (unsigned long i=0; i<stats.deltas; ++i)
+            known_regions = known_regions && data[header.regions_position + i] >= left && data[header.regions_position + i] <= right;
+        CHECK(known_regions);
+    }
+    free(data);
+    if (file != NULL)
+        fclose(file);
+
+    //playback checks the protocol of the keyboard and the header
+    setenv(SIM_ENV, "latency=0,rate=0", 1);
+    hid_device* dev = open_keyboard();
+    CHECK(dev != NULL);
+    CHECK(timeline_play(dev, region_path, false) == 0);
+    struct color colors[SIM_NUM_REGIONS];
+    enum mode mode;
+    sim_get_state(colors, &mode);
+    CHECK(mode == normal && sim_get_stats()->rejected == 0 && sim_get_stats()->received == region_deltas + sim_get_stats()->commits);
+    CHECK(timeline_play(dev, per_key_path, false) == -1);
+
+    write_report_size(region_path, 0);
+    CHECK(timeline_play(dev, region_path, false) == -1);
+    write_report_size(region_path, PROTOCOL_MAX_REPORT_SIZE + 1);
+    CHECK(timeline_play(dev, region_path, false) == -1);
+    write_report_size(region_path, 8);
+    CHECK(timeline_play(dev, region_path, false) == 0);
+    close_keyboard(dev);
+
+    unlink(script_path);
+    unlink(region_path);
+    unlink(per_key_path);
+    return TEST_RESULT("test_timeline");
+}